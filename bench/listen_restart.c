@@ -0,0 +1,262 @@
+// dropped connections across restarts: a client connects in a tight loop
+// while the control socket restarts the server program over and over.
+// the server binding its own port refuses connections until the new
+// process is up; with listen= the supervisor holds the socket and they
+// queue instead. exits non-zero if the listen= round dropped any.
+//
+//   listen_restart [-b ./Msupervisor] [restarts]
+//   listen_restart --serve <startup_ms> [port]    (the server program)
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define RESTARTS 20
+#define STARTUP_MS 50           // server init time before it accepts
+#define RESTART_GAP_MS 100      // steady running between restarts
+#define REPLY_TIMEOUT_SEC 5
+
+typedef struct {
+    volatile int stop;
+    uint64_t attempts, ok, refused, reset;
+} counts_t;
+
+static char supervisor_bin[PATH_MAX] = "./Msupervisor";
+static char self_bin[PATH_MAX];
+static volatile sig_atomic_t stopping = 0;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// ---- server: answer "ok" to each connection, finish it on SIGTERM ----
+
+static void on_term(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static int serve(int startup_ms, int port) {
+    int fd = 3;
+    if (port > 0) {
+        struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        usleep(startup_ms * 1000);
+        if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, SOMAXCONN) != 0) {
+            perror("bind");
+            return 1;
+        }
+    } else {
+        const char *n = getenv("LISTEN_FDS"), *pid = getenv("LISTEN_PID");
+        if (!n || atoi(n) < 1 || !pid || atoi(pid) != getpid()) {
+            fprintf(stderr, "no LISTEN_FDS for pid %d\n", getpid());
+            return 1;
+        }
+        usleep(startup_ms * 1000);
+    }
+
+    // no SA_RESTART: SIGTERM breaks accept() and we leave between requests
+    struct sigaction sa = { .sa_handler = on_term };
+    sigaction(SIGTERM, &sa, NULL);
+
+    while (!stopping) {
+        int c = accept(fd, NULL, NULL);
+        if (c < 0) continue;
+        char b;
+        if (read(c, &b, 1) == 1 && write(c, "ok\n", 3) != 3) {}
+        close(c);
+    }
+    return 0;
+}
+
+// ---- client: one request per connection until told to stop ----
+
+static void client(int port, counts_t *counts) {
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct timeval tv = { .tv_sec = REPLY_TIMEOUT_SEC };
+
+    while (!counts->stop) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        counts->attempts++;
+        if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0) {
+            counts->refused++;
+            close(fd);
+            usleep(100);
+            continue;
+        }
+        char buf[8];
+        if (write(fd, "x", 1) == 1 && read(fd, buf, sizeof(buf)) > 0) counts->ok++;
+        else counts->reset++;
+        close(fd);
+    }
+}
+
+// ---- control socket ----
+
+// send one command and read the whole reply into buf
+static int ctl(const char *path, const char *cmd, char *buf, size_t len) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if (write(fd, cmd, strlen(cmd)) < 0 || write(fd, "\n", 1) != 1 || shutdown(fd, SHUT_WR) != 0) {
+        close(fd);
+        return -1;
+    }
+    size_t got = 0;
+    ssize_t n;
+    while (got + 1 < len && (n = read(fd, buf + got, len - 1 - got)) > 0) got += (size_t)n;
+    buf[got] = '\0';
+    close(fd);
+    return strncmp(buf, "OK", 2) == 0 ? 0 : -1;
+}
+
+static pid_t running_pid(const char *sock) {
+    char buf[512];
+    if (ctl(sock, "status srv", buf, sizeof(buf)) != 0 || !strstr(buf, " RUNNING ")) return 0;
+    const char *p = strstr(buf, "pid=");
+    return p ? (pid_t)atoi(p + 4) : 0;
+}
+
+static int free_port(void) {
+    struct sockaddr_in sa = { .sin_family = AF_INET };
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(sa);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 ||
+        getsockname(fd, (struct sockaddr *)&sa, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return ntohs(sa.sin_port);
+}
+
+// one round: restart srv `restarts` times under client load
+static int run(int use_listen, int restarts, counts_t *counts) {
+    memset(counts, 0, sizeof(*counts));
+    int port = free_port();
+    char dir[] = "/tmp/supervisor-listen-XXXXXX";
+    if (port < 0 || !mkdtemp(dir)) return -1;
+
+    char conf[PATH_MAX], sock[PATH_MAX];
+    snprintf(conf, sizeof(conf), "%s/bench.conf", dir);
+    snprintf(sock, sizeof(sock), "%s/bench.sock", dir);
+    FILE *f = fopen(conf, "w");
+    if (!f) return -1;
+    fprintf(f, "supervisor\ncontrol_socket=%s\nsample_interval=0\n\n", sock);
+    fprintf(f, "program srv\nautorestart=always\nrestart_delay=0\nstop_timeout=5\n");
+    if (use_listen)
+        fprintf(f, "command=%s --serve %d\nlisten=tcp:127.0.0.1:%d\n", self_bin, STARTUP_MS, port);
+    else
+        fprintf(f, "command=%s --serve %d %d\n", self_bin, STARTUP_MS, port);
+    fclose(f);
+
+    pid_t sup = fork();
+    if (sup == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        execl(supervisor_bin, supervisor_bin, conf, (char *)NULL);
+        _exit(127);
+    }
+
+    // first server up and accepting before the load starts
+    uint64_t t0 = now_us();
+    pid_t pid;
+    while (!(pid = running_pid(sock)) && now_us() - t0 < 5000000) usleep(1000);
+    usleep(STARTUP_MS * 2000);
+
+    pid_t cl = pid ? fork() : -1;
+    if (cl == 0) {
+        client(port, counts);
+        _exit(0);
+    }
+
+    char buf[512];
+    int done = 0;
+    for (; cl > 0 && done < restarts; done++) {
+        usleep(RESTART_GAP_MS * 1000);
+        if (ctl(sock, "restart srv", buf, sizeof(buf)) != 0) break;
+        // wait for the replacement, then give it time to initialize
+        pid_t old = pid;
+        t0 = now_us();
+        while (((pid = running_pid(sock)) == 0 || pid == old) && now_us() - t0 < 5000000)
+            usleep(1000);
+        usleep(STARTUP_MS * 1000);
+    }
+
+    counts->stop = 1;
+    if (cl > 0) waitpid(cl, NULL, 0);
+    kill(sup, SIGTERM);
+    waitpid(sup, NULL, 0);
+
+    unlink(conf);
+    rmdir(dir);
+    return done == restarts ? 0 : -1;
+}
+
+static void report(const char *mode, const counts_t *c) {
+    uint64_t dropped = c->refused + c->reset;
+    printf("  %-10s %10llu %10llu %10llu %10llu %9.3f%%\n", mode,
+           (unsigned long long)c->attempts, (unsigned long long)c->ok,
+           (unsigned long long)c->refused, (unsigned long long)c->reset,
+           c->attempts ? 100.0 * (double)dropped / (double)c->attempts : 0.0);
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 3 && strcmp(argv[1], "--serve") == 0)
+        return serve(atoi(argv[2]), argc > 3 ? atoi(argv[3]) : 0);
+
+    int restarts = RESTARTS;
+    const char *bin = supervisor_bin;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) bin = argv[++i];
+        else restarts = atoi(argv[i]);
+    }
+    if (!realpath(bin, supervisor_bin) || !realpath("/proc/self/exe", self_bin)) {
+        fprintf(stderr, "supervisor binary not found: %s\n", bin);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // counters are written by the client process
+    counts_t *counts = mmap(NULL, 2 * sizeof(counts_t), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (counts == MAP_FAILED) return 1;
+
+    int rc_bind = run(0, restarts, &counts[0]);
+    int rc_listen = run(1, restarts, &counts[1]);
+
+    printf("listen_restart: %d restarts, %dms server startup\n", restarts, STARTUP_MS);
+    printf("  %-10s %10s %10s %10s %10s %10s\n", "mode", "attempts", "ok", "refused", "reset", "dropped");
+    report("self-bind", &counts[0]);
+    report("listen=", &counts[1]);
+
+    if (rc_bind != 0 || rc_listen != 0) {
+        fprintf(stderr, "listen_restart: a round did not complete\n");
+        return 1;
+    }
+    return counts[1].refused + counts[1].reset ? 1 : 0;
+}
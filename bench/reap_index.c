@@ -0,0 +1,68 @@
+// per-reap lookup cost as the number of supervised programs grows:
+// pid -> slot via the open-addressing index vs. the old linear scan.
+// each round simulates reap + respawn (lookup, remove, insert new pid).
+#include "pidmap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define ROUNDS 200000
+#define PID_MAX 4194304
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int next_pid(pidmap_t *m) {
+    int pid;
+    do pid = 2 + rand() % (PID_MAX - 2); while (pidmap_get(m, pid) >= 0);
+    return pid;
+}
+
+int main(void) {
+    static const size_t sizes[] = { 10, 100, 1000, 10000, 100000 };
+    volatile long sink = 0;
+
+    printf("%8s %14s %14s\n", "programs", "index ns/reap", "scan ns/reap");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        pidmap_t m = {0};
+        int *pids = malloc(n * sizeof(int));
+
+        srand(42);
+        for (size_t i = 0; i < n; i++) {
+            pids[i] = next_pid(&m);
+            pidmap_put(&m, pids[i], i);
+        }
+
+        uint64_t t0 = now_ns();
+        for (int r = 0; r < ROUNDS; r++) {
+            int pid = pids[rand() % n];
+            long slot = pidmap_get(&m, pid);
+            pidmap_remove(&m, pid);
+            pids[slot] = next_pid(&m);
+            pidmap_put(&m, pids[slot], (size_t)slot);
+            sink += slot;
+        }
+        uint64_t indexed = now_ns() - t0;
+
+        int scan_rounds = n > 10000 ? ROUNDS / 100 : ROUNDS;
+        t0 = now_ns();
+        for (int r = 0; r < scan_rounds; r++) {
+            int pid = pids[rand() % n];
+            for (size_t i = 0; i < n; i++) {
+                if (pids[i] == pid) { sink += (long)i; break; }
+            }
+        }
+        uint64_t scanned = now_ns() - t0;
+
+        printf("%8zu %14.1f %14.1f\n", n,
+               (double)indexed / ROUNDS, (double)scanned / scan_rounds);
+        pidmap_free(&m);
+        free(pids);
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+// exit-to-reap latency: time from a child's last instruction before _exit()
+// to the supervisor having reaped it. compares the epoll/pidfd core against
+// the old 100ms usleep + waitpid(WNOHANG) polling loop.
+#include "event.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+static volatile uint64_t *exit_ns;   // shared with the child
+static uint64_t reaped_ns;
+static pid_t child;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static pid_t spawn_exiting_child(void) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        usleep(1000);
+        *exit_ns = now_ns();
+        _exit(0);
+    }
+    return pid;
+}
+
+static void on_exit_ready(int fd, uint32_t events, void *ctx) {
+    (void)fd; (void)events; (void)ctx;
+    if (waitpid(child, NULL, WNOHANG) == child)
+        reaped_ns = now_ns();
+}
+
+static uint64_t sample_epoll(void) {
+    reaped_ns = 0;
+    child = spawn_exiting_child();
+    int pidfd = (int)syscall(SYS_pidfd_open, child, 0);
+    event_add(pidfd, EPOLLIN, on_exit_ready, NULL);
+    while (!reaped_ns)
+        event_wait(-1);
+    event_del(pidfd);
+    close(pidfd);
+    return reaped_ns - *exit_ns;
+}
+
+static uint64_t sample_poll(void) {
+    child = spawn_exiting_child();
+    for (;;) {
+        if (waitpid(-1, NULL, WNOHANG) == child)
+            return now_ns() - *exit_ns;
+        usleep(100000);
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, uint64_t *v, int n) {
+    qsort(v, n, sizeof(uint64_t), cmp_u64);
+    printf("%-14s n=%-5d p50=%8.1fus p99=%10.1fus max=%10.1fus\n", name, n,
+           v[n / 2] / 1e3, v[(n * 99) / 100] / 1e3, v[n - 1] / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    int poll_iterations = 20;
+
+    exit_ns = mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (exit_ns == MAP_FAILED || event_init() != 0) {
+        perror("setup failed");
+        return 1;
+    }
+
+    uint64_t *v = calloc(iterations, sizeof(uint64_t));
+    for (int i = 0; i < iterations; i++) v[i] = sample_epoll();
+    report("epoll+pidfd", v, iterations);
+
+    for (int i = 0; i < poll_iterations; i++) v[i] = sample_poll();
+    report("usleep-poll", v, poll_iterations);
+
+    free(v);
+    event_close();
+    return 0;
+}
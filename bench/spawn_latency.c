@@ -0,0 +1,81 @@
+// spawn cost per engine: parent-side time to get a child started and the
+// full spawn -> exec -> reap round trip of /bin/true. an optional RSS
+// ballast (MB) shows the fork-style page table copy growing with the
+// supervisor's footprint. pass a cgroup2 directory to spawn into it.
+#include "spawn.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define ITERATIONS 500
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(spawn_engine_t engine, int cgroup_fd, size_t ballast_mb) {
+    static uint64_t parent[ITERATIONS], total[ITERATIONS];
+    char *const argv[] = { (char *)"true", NULL };
+    spawn_req_t req = {
+        .path = "/bin/true", .argv = argv, .envp = NULL,
+        .stdout_fd = -1, .stderr_fd = -1,
+        .cgroup_fd = cgroup_fd, .sigmask = NULL, .engine = engine,
+    };
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        int pidfd;
+        uint64_t t0 = now_ns();
+        pid_t pid = spawn_process(&req, &pidfd);
+        uint64_t t1 = now_ns();
+        if (pid < 0) {
+            printf("%-8s %6zuMB  failed: %s\n", spawn_engine_str(engine), ballast_mb, strerror(errno));
+            return;
+        }
+        waitpid(pid, NULL, 0);
+        total[i] = now_ns() - t0;
+        parent[i] = t1 - t0;
+        if (pidfd >= 0) close(pidfd);
+    }
+
+    qsort(parent, ITERATIONS, sizeof(uint64_t), cmp_u64);
+    qsort(total, ITERATIONS, sizeof(uint64_t), cmp_u64);
+    printf("%-8s %6zuMB  parent p50=%8.1fus  round-trip p50=%8.1fus p99=%8.1fus\n",
+           spawn_engine_str(engine), ballast_mb,
+           parent[ITERATIONS / 2] / 1e3, total[ITERATIONS / 2] / 1e3,
+           total[ITERATIONS * 99 / 100] / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    int cgroup_fd = -1;
+    if (argc > 1) {
+        cgroup_fd = open(argv[1], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (cgroup_fd < 0) perror("open cgroup");
+    }
+
+    static const size_t ballasts[] = { 0, 256 };
+    static const spawn_engine_t engines[] = { SPAWN_FORK, SPAWN_VFORK, SPAWN_CLONE3 };
+
+    for (size_t b = 0; b < sizeof(ballasts) / sizeof(ballasts[0]); b++) {
+        size_t bytes = ballasts[b] * 1024 * 1024;
+        char *ballast = bytes ? malloc(bytes) : NULL;
+        if (ballast) memset(ballast, 1, bytes);   // fault it in
+
+        for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+            run(engines[e], cgroup_fd, ballasts[b]);
+        free(ballast);
+    }
+    return 0;
+}
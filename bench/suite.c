@@ -0,0 +1,406 @@
+// end-to-end benchmark suite: runs the real supervisor binary against
+// generated configs of N trivial programs and prints JSON.
+//
+//   suite [-b ./Msupervisor] [-o out.json] [N...]     (default N: 10 100 1000 10000)
+//
+// per N: config load time (in-process load_config), spawn throughput
+// (exec to every program RUNNING), exit-to-reap and crash-to-restart
+// latency (kill a child, poll the control socket), supervisor RSS/CPU
+// idle and under kill churn, and SIGTERM-to-exit shutdown time.
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define REAP_PROGRAMS 20        // autorestart=never, used for reap latency
+#define LATENCY_SAMPLES 50
+#define IDLE_WINDOW_MS 1000
+#define CHURN_WINDOW_MS 1000
+#define START_TIMEOUT_MS 120000
+
+static char supervisor_bin[PATH_MAX] = "./Msupervisor";
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// ---- control socket client (one connection, many requests) ----
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len, cap;
+} ctl_t;
+
+static int ctl_connect(ctl_t *c, const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (c->fd < 0) return -1;
+    if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void ctl_close(ctl_t *c) {
+    if (c->fd >= 0) close(c->fd);
+    free(c->buf);
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+}
+
+// send one command, return the reply body (lines after the header) or NULL
+static const char *ctl_query(ctl_t *c, const char *cmd, size_t *lines) {
+    size_t n = strlen(cmd);
+    if (write(c->fd, cmd, n) != (ssize_t)n || write(c->fd, "\n", 1) != 1)
+        return NULL;
+
+    c->len = 0;
+    size_t want = (size_t)-1, seen = 0;
+    for (;;) {
+        if (c->cap - c->len < 65536) {
+            c->cap = c->cap ? c->cap * 2 : 1 << 20;
+            c->buf = realloc(c->buf, c->cap);
+        }
+        ssize_t r = read(c->fd, c->buf + c->len, c->cap - c->len - 1);
+        if (r <= 0) return NULL;
+        for (char *p = c->buf + c->len; p < c->buf + c->len + r; p++) {
+            if (*p != '\n') continue;
+            if (want == (size_t)-1) {
+                if (strncmp(c->buf, "OK ", 3) != 0) return NULL;
+                want = strtoul(c->buf + 3, NULL, 10);
+            } else {
+                seen++;
+            }
+        }
+        c->len += (size_t)r;
+        if (want != (size_t)-1 && seen >= want) break;
+    }
+    c->buf[c->len] = '\0';
+    if (lines) *lines = want;
+    return strchr(c->buf, '\n') + 1;
+}
+
+// pid of one program from "name STATE pid=N ..."
+static pid_t ctl_pid(ctl_t *c, const char *name) {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "status %s", name);
+    const char *body = ctl_query(c, cmd, NULL);
+    const char *p = body ? strstr(body, "pid=") : NULL;
+    return p ? (pid_t)atoi(p + 4) : -1;
+}
+
+static size_t count_running(ctl_t *c) {
+    size_t lines, running = 0;
+    const char *body = ctl_query(c, "status --all", &lines);
+    for (const char *p = body; p && (p = strstr(p, " RUNNING ")); p++)
+        running++;
+    return running;
+}
+
+// ---- /proc readings for the supervisor process ----
+
+static long proc_rss_kb(pid_t pid) {
+    char path[64], line[256];
+    long kb = -1;
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmRSS: %ld", &kb) == 1) break;
+    }
+    fclose(f);
+    return kb;
+}
+
+// utime + stime in microseconds
+static uint64_t proc_cpu_us(pid_t pid) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+
+    // fields after the ")" of comm: state is field 3, utime 14, stime 15
+    char *p = strrchr(buf, ')');
+    unsigned long utime = 0, stime = 0;
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                     &utime, &stime) != 2)
+        return 0;
+    return (uint64_t)(utime + stime) * 1000000ull / (uint64_t)sysconf(_SC_CLK_TCK);
+}
+
+// ---- stats ----
+
+typedef struct { double p50, p99, max; size_t n; } dist_t;
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y);
+}
+
+static dist_t distribution(uint64_t *v, size_t n) {
+    dist_t d = {0};
+    if (n == 0) return d;
+    qsort(v, n, sizeof(uint64_t), cmp_u64);
+    d.p50 = (double)v[n / 2];
+    d.p99 = (double)v[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1];
+    d.max = (double)v[n - 1];
+    d.n = n;
+    return d;
+}
+
+// ---- one run ----
+
+typedef struct {
+    size_t programs;
+    double load_ms;
+    double spawn_ms;
+    dist_t reap_us;
+    dist_t restart_us;
+    long idle_rss_kb;
+    double idle_cpu_pct;
+    double churn_kills_per_sec;
+    long churn_rss_kb;
+    double churn_cpu_pct;
+    double shutdown_ms;
+    int ok;
+} result_t;
+
+static size_t reap_count(size_t n) {
+    return n / 2 < REAP_PROGRAMS ? n / 2 : REAP_PROGRAMS;
+}
+
+static int write_config(const char *path, size_t n) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "supervisor\ncontrol_socket=bench.sock\nsample_interval=0\n\n");
+    for (size_t i = 0; i < n; i++) {
+        int reap = i < reap_count(n);
+        fprintf(f, "program %s%zu\ncommand=sleep 3600\nautostart=true\n"
+                   "autorestart=%s\nrestart_delay=0\nstop_timeout=10\n\n",
+                reap ? "r" : "p", i, reap ? "never" : "always");
+    }
+    return fclose(f);
+}
+
+static double load_time_ms(const char *path) {
+    double best = 1e18;
+    for (int k = 0; k < 5; k++) {
+        supervisor_config_t cfg;
+        uint64_t t0 = now_us();
+        if (load_config(path, &cfg) != 0) return -1;
+        uint64_t t = now_us() - t0;
+        free_config(&cfg);
+        if (t < best) best = (double)t;
+    }
+    return best / 1000.0;
+}
+
+// kill a child and time until the control socket shows the expected state
+static uint64_t kill_and_wait(ctl_t *c, const char *name, int expect_restart) {
+    pid_t pid = ctl_pid(c, name);
+    if (pid <= 0) return 0;
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "status %s", name);
+    uint64_t t0 = now_us();
+    kill(pid, SIGKILL);
+    for (;;) {
+        const char *body = ctl_query(c, cmd, NULL);
+        const char *p = body ? strstr(body, "pid=") : NULL;
+        if (!p) return 0;
+        pid_t now = (pid_t)atoi(p + 4);
+        if (expect_restart ? (now > 0 && now != pid && strstr(body, " RUNNING "))
+                           : now == 0)
+            return now_us() - t0;
+        if (now_us() - t0 > 5000000) return 0;
+    }
+}
+
+static void run_one(size_t n, result_t *res) {
+    memset(res, 0, sizeof(*res));
+    res->programs = n;
+
+    char dir[] = "/tmp/supervisor-bench-XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char conf[PATH_MAX], sock[PATH_MAX];
+    snprintf(conf, sizeof(conf), "%s/bench.conf", dir);
+    snprintf(sock, sizeof(sock), "%s/bench.sock", dir);
+    if (write_config(conf, n) != 0) return;
+
+    res->load_ms = load_time_ms(conf);
+
+    uint64_t t0 = now_us();
+    pid_t sup = fork();
+    if (sup == 0) {
+        if (chdir(dir) != 0) _exit(127);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+        execl(supervisor_bin, supervisor_bin, "bench.conf", (char *)NULL);
+        _exit(127);
+    }
+
+    ctl_t c = { .fd = -1 };
+    while (ctl_connect(&c, sock) != 0) {
+        if (now_us() - t0 > START_TIMEOUT_MS * 1000ull) goto out;
+        usleep(200);
+    }
+    // big status replies cost the supervisor time too, so poll less often
+    while (count_running(&c) < n) {
+        if (now_us() - t0 > START_TIMEOUT_MS * 1000ull) goto out;
+        usleep(n < 1000 ? 500 : 10000);
+    }
+    res->spawn_ms = (now_us() - t0) / 1000.0;
+
+    // idle: nothing happens, the loop should be asleep
+    uint64_t cpu0 = proc_cpu_us(sup);
+    usleep(IDLE_WINDOW_MS * 1000);
+    res->idle_cpu_pct = (proc_cpu_us(sup) - cpu0) / (IDLE_WINDOW_MS * 10.0);
+    res->idle_rss_kb = proc_rss_kb(sup);
+
+    char name[32];
+    uint64_t samples[LATENCY_SAMPLES];
+    size_t got = 0;
+    for (size_t i = 0; i < reap_count(n); i++) {
+        snprintf(name, sizeof(name), "r%zu", i);
+        uint64_t t = kill_and_wait(&c, name, 0);
+        if (t) samples[got++] = t;
+    }
+    res->reap_us = distribution(samples, got);
+
+    got = 0;
+    size_t first = reap_count(n);
+    for (size_t k = 0; k < LATENCY_SAMPLES && first < n; k++) {
+        snprintf(name, sizeof(name), "p%zu", first + k % (n - first));
+        uint64_t t = kill_and_wait(&c, name, 1);
+        if (t) samples[got++] = t;
+    }
+    res->restart_us = distribution(samples, got);
+
+    // churn: SIGKILL restartable programs round-robin as fast as the
+    // control socket hands out pids
+    size_t kills = 0;
+    cpu0 = proc_cpu_us(sup);
+    uint64_t c0 = now_us();
+    for (size_t k = 0; first < n && now_us() - c0 < CHURN_WINDOW_MS * 1000ull; k++) {
+        snprintf(name, sizeof(name), "p%zu", first + k % (n - first));
+        pid_t pid = ctl_pid(&c, name);
+        if (pid > 0 && kill(pid, SIGKILL) == 0) kills++;
+    }
+    double window = (now_us() - c0) / 1e6;
+    res->churn_kills_per_sec = kills / window;
+    res->churn_cpu_pct = (proc_cpu_us(sup) - cpu0) / (window * 1e4);
+    res->churn_rss_kb = proc_rss_kb(sup);
+
+    // let the churn settle so shutdown sees a steady fleet
+    while (count_running(&c) < n - first)
+        usleep(10000);
+
+    ctl_close(&c);
+    uint64_t s0 = now_us();
+    kill(sup, SIGTERM);
+    waitpid(sup, NULL, 0);
+    res->shutdown_ms = (now_us() - s0) / 1000.0;
+    res->ok = 1;
+    sup = -1;
+
+out:
+    ctl_close(&c);
+    if (sup > 0) {
+        kill(sup, SIGKILL);
+        waitpid(sup, NULL, 0);
+    }
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd) != 0) fprintf(stderr, "could not remove %s\n", dir);
+}
+
+static void print_dist(FILE *f, const char *key, const dist_t *d) {
+    fprintf(f, "      \"%s\": {\"samples\": %zu, \"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f},\n",
+            key, d->n, d->p50, d->p99, d->max);
+}
+
+static void print_json(FILE *f, const result_t *r, size_t count) {
+    fprintf(f, "{\n  \"suite\": \"supervisor\",\n  \"results\": [\n");
+    for (size_t i = 0; i < count; i++) {
+        fprintf(f, "    {\n");
+        fprintf(f, "      \"programs\": %zu,\n", r[i].programs);
+        fprintf(f, "      \"ok\": %s,\n", r[i].ok ? "true" : "false");
+        fprintf(f, "      \"config_load_ms\": %.3f,\n", r[i].load_ms);
+        fprintf(f, "      \"spawn_all_ms\": %.1f,\n", r[i].spawn_ms);
+        fprintf(f, "      \"spawn_per_sec\": %.0f,\n",
+                r[i].spawn_ms > 0 ? r[i].programs / (r[i].spawn_ms / 1000.0) : 0.0);
+        print_dist(f, "reap_latency_us", &r[i].reap_us);
+        print_dist(f, "restart_latency_us", &r[i].restart_us);
+        fprintf(f, "      \"idle\": {\"rss_kb\": %ld, \"cpu_pct\": %.2f},\n",
+                r[i].idle_rss_kb, r[i].idle_cpu_pct);
+        fprintf(f, "      \"churn\": {\"kills_per_sec\": %.0f, \"rss_kb\": %ld, \"cpu_pct\": %.2f},\n",
+                r[i].churn_kills_per_sec, r[i].churn_rss_kb, r[i].churn_cpu_pct);
+        fprintf(f, "      \"shutdown_ms\": %.1f\n", r[i].shutdown_ms);
+        fprintf(f, "    }%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    size_t sizes[16] = {10, 100, 1000, 10000};
+    size_t count = 4, given = 0;
+    const char *out_path = NULL;
+    const char *bin = supervisor_bin;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            bin = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (given < 16) {
+            sizes[given++] = strtoul(argv[i], NULL, 10);
+        }
+    }
+    if (given) count = given;
+
+    if (!realpath(bin, supervisor_bin)) {
+        fprintf(stderr, "supervisor binary not found: %s\n", bin);
+        return 1;
+    }
+
+    result_t results[16];
+    for (size_t i = 0; i < count; i++) {
+        fprintf(stderr, "suite: %zu programs...\n", sizes[i]);
+        run_one(sizes[i], &results[i]);
+    }
+
+    FILE *f = out_path ? fopen(out_path, "w") : stdout;
+    if (!f) {
+        perror(out_path);
+        return 1;
+    }
+    print_json(f, results, count);
+    if (f != stdout) fclose(f);
+
+    for (size_t i = 0; i < count; i++) {
+        if (!results[i].ok) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// bump allocator for config data: everything is freed at once, and
+// interned strings are stored once no matter how many programs use them
+typedef struct arena_chunk arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *chunks;
+    char *cur;                 // free space in the newest chunk
+    size_t left;
+    const char **strings;      // intern set, open addressing
+    size_t cap;                // power of two
+    size_t len;
+    size_t bytes;              // total chunk bytes, for stats
+} arena_t;
+
+void arena_init(arena_t *a);
+void *arena_alloc(arena_t *a, size_t size);                    // 8-byte aligned, NULL on OOM
+const char *arena_intern(arena_t *a, const char *s, size_t len); // NUL-terminated copy
+void arena_free(arena_t *a);
+
+#endif
@@ -1,10 +1,59 @@
 #ifndef CGROUP_H
 #define CGROUP_H
 
+#include <stdint.h>
 #include <sys/types.h>
 #include "config.h"
 
-int cgroup_setup(program_config_t *p, pid_t pid);
-void cgroup_cleanup(const char *name);
+// what failed, for the caller to report
+typedef struct {
+    int err;              // errno
+    const char *op;       // "mkdir", "open", "write", ...
+    char file[64];        // control file or directory involved
+} cgroup_error_t;
+
+// longest path below supervisor/: "<pool>/<instance>.standby"
+#define CGROUP_PATH_LEN (MAX_NAME_LEN + 1 + 11 + sizeof(".standby"))
+
+// persistent handle on one program cgroup; numprocs instances live in
+// supervisor/<pool>/<instance> and share the pool's aggregate limits
+typedef struct {
+    int dirfd;                   // -1 when not open
+    int pool_fd;                 // parent pool cgroup, -1 for a plain program
+    char name[CGROUP_PATH_LEN];  // path below supervisor/
+    long memory_max;             // last value written, -1 = never
+    long cpu_quota;              // last value written, -1 = never
+    long cpu_period;
+    long pool_memory_max;        // same for the pool, rewritten by every instance
+    long pool_cpu_quota;
+    long pool_cpu_period;
+    long memory_high;            // -1 = never written (kernel default)
+    long swap_max;
+    long cpu_weight;
+    long pids_max;
+    char *io_max;                // io.max / io.weight lines last written, NULL = none
+    char *io_weight;
+    char cpus[64];               // cpuset.cpus last written, "" = inherited
+    char mems[32];               // cpuset.mems
+    int events_fd;               // memory.events, polled for EPOLLPRI
+    uint64_t oom_kills;          // last oom_kill count seen
+    int state_fd;                // cgroup.events (populated, frozen), polled for EPOLLPRI
+    int killed;                  // cgroup.kill was written, see cgroup_kill
+} cgroup_t;
+
+void cgroup_init(cgroup_t *cg);
+int cgroup_open(cgroup_t *cg, const char *name, cgroup_error_t *err);
+int cgroup_apply(cgroup_t *cg, const program_config_t *p, cgroup_error_t *err);
+int cgroup_write(cgroup_t *cg, const char *file, const char *value, cgroup_error_t *err);
+int cgroup_watch_events(cgroup_t *cg, cgroup_error_t *err);
+int cgroup_read_oom_kills(cgroup_t *cg, uint64_t *count);
+int cgroup_watch_state(cgroup_t *cg, cgroup_error_t *err);
+int cgroup_read_state(cgroup_t *cg, int *populated, int *frozen);   // either may be NULL
+int cgroup_kill(cgroup_t *cg, cgroup_error_t *err);   // SIGKILL to every process inside
+int cgroup_freeze(cgroup_t *cg, int frozen, cgroup_error_t *err);
+int cgroup_squeeze_memory(cgroup_t *cg, cgroup_error_t *err);   // memory.high below current usage
+int cgroup_migrate(cgroup_t *from, cgroup_t *to, cgroup_error_t *err);   // every process of from
+int cgroup_close(cgroup_t *cg, int remove, cgroup_error_t *err);   // remove = rmdir it
+const char *cgroup_strerror(const cgroup_error_t *err, char *buf, size_t len);
 
 #endif
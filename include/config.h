@@ -3,11 +3,10 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include "arena.h"
 
-#define MAX_PROGRAMS 64
-#define MAX_NAME_LEN 64
-#define MAX_COMMAND_LEN 256
-#define MAX_PATH_LEN 256
+#define MAX_NAME_LEN 64          // program names double as cgroup names
+#define DEFAULT_CONTROL_SOCKET "supervisor.sock"
 
 // restart policy enum
 typedef enum {
@@ -16,27 +15,138 @@ typedef enum {
     RESTART_ALWAYS
 } restart_policy_t;
 
-// structure for program config
+// how a running program is replaced on restart
+typedef enum {
+    RESTART_MODE_STOP_START,   // stop, wait for the exit, spawn again
+    RESTART_MODE_ROLLING       // spawn the replacement, stop the old one once it is ready
+} restart_mode_t;
+
+// health check probe kinds
+typedef enum {
+    HEALTH_NONE,
+    HEALTH_EXEC,     // command exits 0
+    HEALTH_TCP,      // connect() succeeds
+    HEALTH_HTTP,     // GET answers 2xx/3xx
+    HEALTH_FILE      // file exists (and is fresh with healthcheck_maxage)
+} health_type_t;
+
+// PSI triggers: the cgroup's <resource>.pressure file to watch, and what
+// to do when the program stalls past the threshold
+typedef enum {
+    PRESSURE_MEMORY,
+    PRESSURE_CPU,
+    PRESSURE_IO
+} pressure_resource_t;
+
+typedef enum {
+    PRESSURE_LOG,        // just report it
+    PRESSURE_THROTTLE,   // pull memory.high below current usage
+    PRESSURE_FREEZE,     // cgroup.freeze until pressure_cooldown passes quietly
+    PRESSURE_RESTART     // graceful restart, at most once per pressure_cooldown
+} pressure_action_t;
+
+#define MAX_PRESSURE_TRIGGERS 4   // per program
+
+typedef struct {
+    pressure_resource_t resource;
+    bool full;               // every task stalled at once, rather than "some"
+    int stall_ms;            // stall time within the window that fires
+    int window_ms;           // 500-10000, the kernel's limits
+    pressure_action_t action;
+} pressure_trigger_t;
+
+// structure for program config; strings live in the config arena and
+// are never NULL ("" when unset), except argv/exec_path with shell=true
 typedef struct {
-    char name[MAX_NAME_LEN];
-    char command[MAX_COMMAND_LEN];
+    const char *name;
+    const char *command;
+    bool shell;              // run via /bin/sh -c instead of direct exec
+    char **argv;             // pre-split command, NULL when shell=true
+    const char *exec_path;   // argv[0] resolved against PATH at load time
     bool autostart;
     restart_policy_t autorestart;
     int restart_delay;       // seconds
+    restart_mode_t restart_mode;
+    bool standby;            // keep a warm spare to promote when the active one exits
+    bool standby_freeze;     // freeze the warm spare's cgroup until it is promoted
+    bool freeze_on_pressure; // may be frozen while the host is under pressure
+    pressure_trigger_t pressure[MAX_PRESSURE_TRIGGERS];   // PSI triggers on its own cgroup
+    int pressure_count;
+    int pressure_cooldown;   // seconds without a trigger before throttle/freeze are undone
     int max_restarts;
+    double backoff_factor;   // delay multiplier per consecutive restart, 1 = flat
+    int backoff_max;         // seconds, 0 = no cap
+    double backoff_jitter;   // 0<=x<1, fraction of the delay randomized away
+    restart_policy_t oom_restart;  // policy after an OOM kill, defaults to autorestart
+    int oom_restart_delay;   // seconds, defaults to restart_delay
+    double oom_backoff_factor;
+    int oom_backoff_max;     // seconds, 0 = no cap
     long memory_limit_bytes;   //MB
     double cpu_limit;      //0<x<1
-    char stdout_path[MAX_PATH_LEN];
-    char stderr_path[MAX_PATH_LEN];
+    int cpu_period_us;       // cpu.max period for cpu_limit
+    long memory_high_bytes;  // memory.high, throttles before the OOM killer, -1 = unset
+    long memory_swap_max_bytes;  // memory.swap.max, -1 = unset
+    int cpu_weight;          // cpu.weight 1-10000, -1 = unset
+    long pids_max;           // pids.max, -1 = unset
+    const char *io_max;      // io.max lines "MAJ:MIN rbps=N wbps=N ...", "" = unset
+    const char *io_weight;   // io.weight lines "default N" / "MAJ:MIN N", "" = unset
+    const char *listen;      // sockets held across restarts, "tcp:ADDR:PORT" / "unix:/path" lines, "" = none
+    int numprocs;            // instances this block expands into
+    const char *pool;        // block name when numprocs > 1, "" otherwise
+    int instance;            // 0..numprocs-1 within the pool
+    const char *cpu_affinity;  // cpuset.cpus list ("0-3,6"), "" = inherit
+    const char *numa_node;     // cpuset.mems list, "" = inherit
+    long pool_memory_limit_bytes;  // memory.max of the pool cgroup, shared by instances
+    double pool_cpu_limit;         // cpu.max of the pool cgroup
+    const char *stdout_path;
+    const char *stderr_path;
+    long stdout_maxbytes;    // rotate stdout log at this size, 0 = never
+    int stdout_backups;
+    long stderr_maxbytes;
+    int stderr_backups;
+    int stop_signal;         // sent first on stop/shutdown
+    int stop_timeout;        // seconds before SIGKILL
+    int priority;            // lower starts first and stops last
+    const char *depends_on;  // raw depends_on= list, "" if none
+    size_t *depends;         // program indexes this one waits for
+    size_t ndepends;
+    size_t *dependents;      // reverse edges: programs waiting for this one
+    size_t ndependents;
+    int level;               // longest depends_on chain below this program
+    int startsecs;           // seconds up before it counts as ready
+    health_type_t health_type;
+    const char *health_command;   // exec probe, run with /bin/sh -c
+    const char *health_host;      // tcp/http probe address, IPv4
+    int health_port;
+    const char *health_path;      // http request path, or the file to check
+    int health_interval;     // seconds between probes
+    int health_timeout;      // seconds before a probe counts as failed
+    int health_retries;      // consecutive failures before UNHEALTHY
+    int health_maxage;       // file probe: max seconds since mtime, 0 = exists
+    const char *file;        // where the program block starts, for messages
+    unsigned line;
 } program_config_t;
 
 // structure for entire config file
 typedef struct {
-    program_config_t programs[MAX_PROGRAMS];
+    program_config_t *programs;   // grows as program blocks are parsed
     size_t count;
+    size_t capacity;
+    int sample_interval;          // seconds between cgroup stat samples, 0 = off
+    const char *control_socket;   // unix socket for Msupervisor ctl, "" = off
+    const char *metrics_file;     // Prometheus text file, rewritten atomically, "" = off
+    int metrics_interval;         // seconds between metrics_file rewrites
+    double freeze_memory_pressure;   // host memory "some avg10" (%) that freezes, 0 = off
+    double freeze_cpu_pressure;      // same for cpu
+    arena_t arena;                // every string above and in the programs
 } supervisor_config_t;
 
 // Parser API
 int load_config(const char *filename, supervisor_config_t *config);
+void free_config(supervisor_config_t *config);
+long config_adopt_program(supervisor_config_t *config, const program_config_t *src);  // copy in, index or -1
+int parse_signal(const char *s);
+int parse_cpu_list(const char *s, int *out, int max);   // "0-3,6" -> count, -1 if invalid
+const char *signal_str(int sig);
 
 #endif 
@@ -0,0 +1,27 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stddef.h>
+
+// reply under construction; sent as "OK <lines>" or "ERR <msg>" + lines
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    size_t lines;
+    int failed;
+} ctl_reply_t;
+
+void ctl_printf(ctl_reply_t *r, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void ctl_error(ctl_reply_t *r, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// one request line already split into words
+typedef void (*ctl_handler_t)(int argc, char **argv, ctl_reply_t *reply);
+
+int control_open(const char *path, ctl_handler_t handler);
+void control_close(void);
+
+// client side: send one command, print the reply, 0 on OK
+int control_client(const char *path, int argc, char **argv);
+
+#endif
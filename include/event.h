@@ -0,0 +1,19 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+// callback for a ready fd; handlers must tolerate spurious wakeups
+typedef void (*event_handler_t)(int fd, uint32_t events, void *ctx);
+
+int event_init(void);
+int event_add(int fd, uint32_t events, event_handler_t handler, void *ctx);
+int event_mod(int fd, uint32_t events);
+void event_del(int fd);
+int event_wait(int timeout_ms);
+uint64_t event_woke_us(void);   // when the last event_wait returned, 0 before that
+uint64_t now_us(void);          // CLOCK_MONOTONIC
+void event_close(void);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include "config.h"
+#include <signal.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// result of one probe; detail says why it failed ("" when ok)
+typedef void (*health_done_t)(void *ctx, int ok, const char *detail);
+
+// one program's probe; sockets and exec pidfds ride the event loop, so
+// any number of probes can be in flight without blocking reaping
+typedef struct {
+    int phase;                // idle, connecting, sending, reading, exec, reaping
+    int fd;                   // probe socket or pidfd, -1 if none
+    pid_t pid;                // exec probe child, 0 if none
+    int timer;                // probe timeout, -1 if none
+    int orphan;               // freed while the exec probe was still being reaped
+    char buf[256];            // http request out, then the status line in
+    size_t len;
+    size_t off;
+    char detail[64];
+    health_done_t done;
+    void *ctx;
+} health_probe_t;
+
+health_probe_t *health_new(health_done_t done, void *ctx);
+// start one probe of p; done runs later, or before this returns when the
+// result is known at once; -1 while the previous probe is still busy
+int health_start(health_probe_t *h, const program_config_t *p, const sigset_t *mask);
+int health_busy(const health_probe_t *h);
+void health_cancel(health_probe_t *h);     // drop the probe in flight, done is not called
+void health_free(health_probe_t *h);
+const char *health_type_str(health_type_t t);
+
+#endif
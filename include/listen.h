@@ -0,0 +1,19 @@
+#ifndef LISTEN_H
+#define LISTEN_H
+
+#include <stddef.h>
+
+#define MAX_LISTEN_FDS 16   // sockets per program
+
+// listening sockets the supervisor binds once and hands to every spawn
+// (LISTEN_FDS convention), so connections queue in the kernel while a
+// program restarts. one socket per address, shared by all its holders.
+
+// take a reference on every socket in specs, newline-separated
+// "tcp:ADDR:PORT" / "unix:/path" lines as config.c normalizes them;
+// binds the ones not open yet. returns the fd count, or -1 with nothing
+// held and the reason in err
+int listen_open(const char *specs, int *fds, int max, char *err, size_t errlen);
+void listen_close(const char *specs);   // the last reference closes (and unlinks)
+
+#endif
@@ -4,10 +4,12 @@
 #include <stdio.h>
 
 #define MAX_LOG_SIZE (5 * 1024 * 1024) // 5 MB
-
-extern FILE *supervisor_log;
+#define LOG_RING_SIZE (256 * 1024)     // pending lines between flushes
 
 void open_supervisor_log(void);
-void log_message(const char *fmt, ...); 
+void log_message(const char *fmt, ...); // queued, written by log_flush()
+void log_flush(void);                   // writev pending lines, rotate if big
+void log_install_crash_flush(void);     // flush on fatal signals and exit
+const char *log_timestamp(void);        // "%Y-%m-%d %H:%M:%S", cached per second
 
 #endif 
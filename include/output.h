@@ -0,0 +1,23 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+
+// supervisor-owned child output: the child writes into a pipe, the event
+// loop splice()s the data into the log file and rotates it by size.
+typedef struct {
+    int read_fd;         // supervisor end, registered with the event loop
+    int write_fd;        // handed to every spawn, kept open across restarts
+    int file_fd;
+    char *path;
+    long size;           // current file size
+    long maxbytes;       // rotate at this size, 0 = never
+    int backups;         // rotated files kept as path.1 .. path.N
+    uint64_t retry_us;   // next reopen attempt while file_fd is -1
+    long dropped;        // bytes discarded since the file was lost
+} output_pipe_t;
+
+output_pipe_t *output_open(const char *path, long maxbytes, int backups);
+void output_close(output_pipe_t *o);   // drains what is left in the pipe
+
+#endif
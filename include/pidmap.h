@@ -0,0 +1,19 @@
+#ifndef PIDMAP_H
+#define PIDMAP_H
+
+#include <stddef.h>
+
+// open-addressing hash index: pid (or pidfd) -> runtime slot
+typedef struct {
+    int *keys;        // -1 = empty
+    size_t *vals;
+    size_t cap;       // power of two
+    size_t len;
+} pidmap_t;
+
+int pidmap_put(pidmap_t *m, int key, size_t slot);
+long pidmap_get(const pidmap_t *m, int key);   // -1 if absent
+void pidmap_remove(pidmap_t *m, int key);
+void pidmap_free(pidmap_t *m);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+// PSI (pressure stall information): the share of wall time in which
+// tasks were stalled waiting on memory, cpu or io, host-wide in
+// /proc/pressure/* and per cgroup in <resource>.pressure
+
+#include "config.h"
+
+#define HOST_PRESSURE_DIR "/proc/pressure"
+
+int pressure_open(const char *path);             // O_RDONLY, -1 with errno
+int pressure_read(int fd, double *some_avg10);   // "some" over the last 10s, percent
+
+// PSI trigger on dirfd/file (a cgroup's memory.pressure etc.): the fd
+// turns EPOLLPRI once tasks stall for stall_us within any window_us.
+// window 500ms-10s; the trigger lives as long as the fd
+int pressure_trigger(int dirfd, const char *file, int full, unsigned stall_us, unsigned window_us);
+
+const char *pressure_resource_str(pressure_resource_t r);   // "memory", also the file prefix
+const char *pressure_action_str(pressure_action_t a);
+
+#endif
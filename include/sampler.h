@@ -0,0 +1,36 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SAMPLE_HISTORY 60   // samples kept per program
+
+// one reading of a program cgroup; memory in KiB to keep it compact
+typedef struct {
+    uint32_t t;                  // seconds since the supervisor started
+    uint32_t mem_current_kb;     // memory.current
+    uint32_t mem_peak_kb;        // memory.peak
+    uint32_t mem_anon_kb;        // memory.stat anon
+    uint32_t mem_file_kb;        // memory.stat file
+    uint64_t cpu_usage_usec;     // cpu.stat
+    uint64_t cpu_throttled_usec;
+    uint64_t io_rbytes;          // io.stat, summed over devices
+    uint64_t io_wbytes;
+} resource_sample_t;
+
+// open stat files of one cgroup plus its time-series ring
+typedef struct {
+    int fds[5];                  // memory.current, memory.peak, memory.stat, cpu.stat, io.stat
+    resource_sample_t ring[SAMPLE_HISTORY];
+    size_t head;                 // next slot to write
+    size_t count;
+} sampler_t;
+
+sampler_t *sampler_open(int cgroup_dirfd);
+void sampler_read(sampler_t *s, uint32_t t);
+const resource_sample_t *sampler_latest(const sampler_t *s);            // NULL if none yet
+size_t sampler_history(const sampler_t *s, resource_sample_t *out, size_t max); // oldest first
+void sampler_close(sampler_t *s);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <signal.h>
+#include <sys/types.h>
+
+typedef enum {
+    SPAWN_AUTO,     // clone3 into the cgroup when there is one, else vfork-style
+    SPAWN_CLONE3,   // clone3(CLONE_INTO_CGROUP | CLONE_PIDFD)
+    SPAWN_VFORK,    // clone(CLONE_VM | CLONE_VFORK | CLONE_PIDFD), child joins its cgroup
+    SPAWN_FORK      // plain fork(), kept for comparison
+} spawn_engine_t;
+
+typedef struct {
+    const char *path;          // executable for execve
+    char *const *argv;
+    char *const *envp;         // NULL = inherit environ
+    int stdout_fd;             // -1 = inherit
+    int stderr_fd;             // -1 = inherit
+    int cgroup_fd;             // cgroup directory fd, -1 = none
+    const sigset_t *sigmask;   // restored in the child, NULL = keep
+    const int *listen_fds;     // passed as fds 3.. with LISTEN_FDS/LISTEN_PID set
+    int listen_count;
+    spawn_engine_t engine;
+} spawn_req_t;
+
+// start a child in its own process group; returns pid (or -1 with errno)
+// and stores a pidfd in *pidfd (-1 if the engine could not provide one)
+pid_t spawn_process(const spawn_req_t *req, int *pidfd);
+const char *spawn_engine_str(spawn_engine_t e);
+
+#endif
@@ -2,7 +2,13 @@
 #define SUPERVISOR_H
 
 #include "config.h"
+#include "output.h"
+#include "cgroup.h"
+#include "sampler.h"
+#include "health.h"
+#include "listen.h"
 #include <unistd.h>
+#include <stdint.h>
 
 // program runtime states
 typedef enum {
@@ -11,17 +17,88 @@ typedef enum {
     STATE_RUNNING,     
     STATE_EXITED,      
     STATE_FAILED,      
-    STATE_KILLED       
+    STATE_KILLED,
+    STATE_BACKOFF,     // exited, restart scheduled
+    STATE_OOM,         // killed by the OOM killer
+    STATE_STOPPING,    // stop requested, waiting for exit
+    STATE_WAITING,     // start requested, dependencies not ready yet
+    STATE_UNHEALTHY,   // failed healthcheck_retries probes in a row
+    STATE_FROZEN       // cgroup.freeze confirmed by cgroup.events
 } program_state_t;
 
+// who froze a program; pressure freezes are thawed by the policy,
+// trigger ones after pressure_cooldown, manual ones only by "ctl thaw"
+typedef enum {
+    FREEZE_NONE,
+    FREEZE_MANUAL,
+    FREEZE_PRESSURE,
+    FREEZE_TRIGGER
+} freeze_reason_t;
+
+
+// second process of a slot: the warm standby, or the replacement a
+// rolling restart starts before stopping the running one
+typedef struct {
+    pid_t pid;                    // 0 if none
+    int pidfd;                    // -1 if none
+    int timer;                    // warm-up, or the respawn after a crash, -1 if none
+    int ready;                    // warmed up; may take over the slot
+    int frozen;                   // its cgroup is frozen until promotion
+    uint64_t started_ms;
+    health_probe_t *health;       // readiness probe, created on first use
+    int health_failures;
+    cgroup_t cg;                  // <program>.standby, limited like the program
+} spare_t;
 
 typedef struct {
+    size_t prog;                  // index into supervisor_config_t.programs
     pid_t pid;
+    int pidfd;                    // exit notification, -1 if none
     int restart_count;            // count restarts for ON_FAILURE only
     program_state_t state;     // current state
+    int restart_timer;            // pending restart timer id, -1 if none
+    int stop_timer;               // SIGKILL escalation after a stop, -1 if none
+    int stop_requested;           // exit was asked for, don't apply restart policy
+    int restart_requested;        // spawn again as soon as the stop completes
+    int retired;                  // dropped from the config by a reload
+    int ready;                    // up for startsecs; dependents may start
+    int ready_timer;              // pending startsecs timer id, -1 if none
+    size_t waiting_on;            // dependencies not ready yet
+    int start_pending;            // launch as soon as waiting_on hits 0
+    int booted;                   // has been ready at least once
+    int backoff_streak;           // consecutive quick restarts
+    int oom_streak;               // consecutive quick OOM restarts
+    int oom_count;                // OOM kills seen in this program's cgroup
+    int oom_pending;              // OOM kill not yet matched to an exit
+    uint64_t started_ms;          // monotonic spawn time
+    cgroup_t cg;                  // persistent cgroup handle (dirfd + applied limits)
+    output_pipe_t *out;           // stdout pipe (also stderr when paths match)
+    output_pipe_t *err;
+    sampler_t *sampler;           // cgroup stats time series, NULL without a cgroup
+    health_probe_t *health;       // created on the first probe
+    int health_timer;             // next probe, -1 if none
+    int health_failures;          // consecutive failed probes
+    int health_ok;                // passed a probe since the last spawn
+    uint64_t restarts;            // restarts applied by policy, for metrics
+    uint64_t crashed_us;          // exit that queued a restart, 0 once respawned
+    int last_exit;                // exit code or -signal of the last run
+    char *listen;                 // listen specs the sockets below were opened for, NULL if none
+    int listen_fds[MAX_LISTEN_FDS];
+    int listen_count;
+    spare_t spare;
+    int rolling;                  // the spare replaces the running process once ready
+    int leftovers;                // pid exited, left unreaped until its cgroup empties
+    freeze_reason_t freeze;       // who asked for cgroup.freeze, FREEZE_NONE = thawed
+    uint64_t freeze_us;           // when it was written, for the latency log
+    int psi_fds[MAX_PRESSURE_TRIGGERS];   // armed pressure triggers, -1 where one failed
+    int psi_count;                // triggers armed on cg, 0 = none
+    int trigger_timer;            // pressure_cooldown after the last trigger, -1 if none
+    uint64_t trigger_restart_ms;  // last restart a trigger asked for
+    int squeezed;                 // memory.high pulled down by a throttle trigger
 } program_runtime_t;
 
 
-void supervisor_run(supervisor_config_t *config);
+// config_path is re-read on SIGHUP
+void supervisor_run(supervisor_config_t *config, const char *config_path);
 
 #endif 
@@ -0,0 +1,14 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+typedef void (*timer_fn_t)(void *ctx);
+
+int timer_init(void);
+int timer_add(uint64_t delay_ms, timer_fn_t fn, void *ctx);   // returns timer id
+void timer_cancel(int id);
+uint64_t timer_now_ms(void);
+void timer_close(void);
+
+#endif
@@ -0,0 +1,101 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+    arena_chunk_t *next;
+    char data[];
+};
+
+
+void arena_init(arena_t *a) {
+    memset(a, 0, sizeof(*a));
+}
+
+
+void *arena_alloc(arena_t *a, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+
+    if (size > a->left) {
+        // oversized requests get a chunk of their own and keep the current one
+        size_t want = size > CHUNK_SIZE / 4 ? size : CHUNK_SIZE;
+        arena_chunk_t *c = malloc(sizeof(arena_chunk_t) + want);
+        if (!c) return NULL;
+        c->next = a->chunks;
+        a->chunks = c;
+        a->bytes += want;
+        if (want != size) {
+            a->cur = c->data;
+            a->left = want;
+        } else {
+            return c->data;
+        }
+    }
+
+    void *p = a->cur;
+    a->cur += size;
+    a->left -= size;
+    return p;
+}
+
+
+static uint32_t hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;          // FNV-1a
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+
+static int grow(arena_t *a) {
+    size_t cap = a->cap ? a->cap * 2 : 256;
+    const char **strings = calloc(cap, sizeof(char *));
+    if (!strings) return -1;
+
+    for (size_t i = 0; i < a->cap; i++) {
+        const char *s = a->strings[i];
+        if (!s) continue;
+        size_t b = hash(s, strlen(s)) & (cap - 1);
+        while (strings[b]) b = (b + 1) & (cap - 1);
+        strings[b] = s;
+    }
+    free(a->strings);
+    a->strings = strings;
+    a->cap = cap;
+    return 0;
+}
+
+
+const char *arena_intern(arena_t *a, const char *s, size_t len) {
+    if (a->len * 2 >= a->cap && grow(a) != 0)
+        return NULL;
+
+    size_t b = hash(s, len) & (a->cap - 1);
+    for (const char *e; (e = a->strings[b]); b = (b + 1) & (a->cap - 1)) {
+        if (strncmp(e, s, len) == 0 && e[len] == '\0')
+            return e;
+    }
+
+    char *copy = arena_alloc(a, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    a->strings[b] = copy;
+    a->len++;
+    return copy;
+}
+
+
+void arena_free(arena_t *a) {
+    arena_chunk_t *c = a->chunks;
+    while (c) {
+        arena_chunk_t *next = c->next;
+        free(c);
+        c = next;
+    }
+    free(a->strings);
+    arena_init(a);
+}
@@ -2,115 +2,495 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/vfs.h>
 #include <unistd.h>
 #include <errno.h>
-#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <linux/magic.h>
 #include "cgroup.h"
+#include "logging.h"
 
-#define CGROUP_ROOT "/sys/fs/cgroup"
+#ifndef CGROUP_ROOT
+#define CGROUP_ROOT "/sys/fs/cgroup"   // override with -DCGROUP_ROOT=... for a cgroup2 mount elsewhere
+#endif
 #define SUPERVISOR_GROUP "supervisor"
+#define SQUEEZE_FLOOR (32l << 20)   // memory.high never squeezed below 32MiB
 
+static int root_fd = -1;   // CGROUP_ROOT/supervisor, opened once
 
-static void ensure_dir(const char *path) {
-    if (mkdir(path, 0755) != 0) {
-        if (errno != EEXIST) {
-            perror("mkdir failed");
-        }
+// handed down to program cgroups; each is tried on its own so a missing
+// controller doesn't block the rest
+static const char *const controllers[] = { "+memory", "+cpu", "+cpuset", "+io", "+pids" };
+
+
+static int fail(cgroup_error_t *err, const char *op, const char *file) {
+    if (err) {
+        err->err = errno;
+        err->op = op;
+        snprintf(err->file, sizeof(err->file), "%s", file);
     }
+    return -1;
 }
 
 
-static void write_file(const char *path, const char *value) {
-    FILE *f = fopen(path, "w");
-    if (!f) {
-        perror("fopen failed");
-        return;
+const char *cgroup_strerror(const cgroup_error_t *err, char *buf, size_t len) {
+    snprintf(buf, len, "%s %s: %s", err->op, err->file, strerror(err->err));
+    return buf;
+}
+
+
+// returns a bit per controller that could not be enabled; misses not
+// in quiet are logged against where (a child can't have what its
+// parent lacks, so those are only said once)
+static unsigned enable_controllers(int dirfd, const char *where, unsigned quiet) {
+    size_t count = sizeof(controllers) / sizeof(controllers[0]);
+    int fd = openat(dirfd, "cgroup.subtree_control", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (quiet != ~0u) log_message("Can't enable cgroup controllers in %s: %s\n", where, strerror(errno));
+        return ~0u;
+    }
+    unsigned missing = 0;
+    for (size_t i = 0; i < count; i++) {
+        // not available here; limits that need it fail when written
+        if (write(fd, controllers[i], strlen(controllers[i])) >= 0) continue;
+        missing |= 1u << i;
+        if (!(quiet & (1u << i)))
+            log_message("Can't enable the %s controller in %s: %s\n", controllers[i] + 1, where,
+                        strerror(errno));
     }
+    close(fd);
+    return missing;
+}
+
+
+static int open_root(cgroup_error_t *err) {
+    if (root_fd >= 0) return 0;
 
-    fprintf(f, "%s", value);
-    fclose(f);
+    // supervisor/ only gets the controllers its parent hands down
+    int parent = open(CGROUP_ROOT, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (parent < 0) return fail(err, "open", CGROUP_ROOT);
+
+    // on a hybrid host this is a tmpfs of v1 mounts: directories made
+    // there are not cgroups, so none are used at all
+    struct statfs sfs;
+    int rc = fstatfs(parent, &sfs);
+    if (rc == 0 && sfs.f_type != CGROUP2_SUPER_MAGIC) {
+        errno = ENOTSUP;
+        rc = -1;
+    }
+    if (rc != 0) {
+        int saved = errno;
+        close(parent);
+        errno = saved;
+        return fail(err, "statfs", CGROUP_ROOT);
+    }
+    unsigned missing = enable_controllers(parent, CGROUP_ROOT, 0);
+    close(parent);
+
+    const char *path = CGROUP_ROOT "/" SUPERVISOR_GROUP;
+    if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        return fail(err, "mkdir", path);
+
+    root_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) return fail(err, "open", path);
+    enable_controllers(root_fd, path, missing);
+    return 0;
 }
 
 
-static void apply_cpu_limit(const char *program_path, double cpu_limit) {
-    if (cpu_limit <= 0) return;
+// a fresh directory has nothing of ours in it
+static void forget_applied(cgroup_t *cg) {
+    cg->memory_max = cg->cpu_quota = cg->cpu_period = -1;
+    cg->memory_high = cg->swap_max = cg->cpu_weight = cg->pids_max = -1;
+    free(cg->io_max);
+    free(cg->io_weight);
+    cg->io_max = cg->io_weight = NULL;
+    cg->cpus[0] = cg->mems[0] = '\0';
+}
 
-    char cpu_file[256];
-    snprintf(cpu_file, sizeof(cpu_file),
-             "%s/cpu.max", program_path);
+void cgroup_init(cgroup_t *cg) {
+    cg->dirfd = -1;
+    cg->pool_fd = -1;
+    cg->name[0] = '\0';
+    cg->io_max = cg->io_weight = NULL;
+    forget_applied(cg);
+    cg->pool_memory_max = cg->pool_cpu_quota = cg->pool_cpu_period = -1;
+    cg->events_fd = -1;
+    cg->oom_kills = 0;
+    cg->state_fd = -1;
+    cg->killed = 0;
+}
 
-    long quota = (long)(cpu_limit * 100000); // 0.5 CPU to 50000
-    char value[64];
-    snprintf(value, sizeof(value), "%ld 100000", quota);
 
-    write_file(cpu_file, value);
+// create (or adopt) supervisor/<name> and keep its dirfd; a name of
+// the form pool/instance creates the pool first and keeps it open too
+int cgroup_open(cgroup_t *cg, const char *name, cgroup_error_t *err) {
+    if (cg->dirfd >= 0) return 0;
+    if (strlen(name) >= sizeof(cg->name)) {   // close() removes it by this name
+        errno = ENAMETOOLONG;
+        return fail(err, "mkdir", name);
+    }
+    if (open_root(err) != 0) return -1;
+
+    const char *slash = strchr(name, '/');
+    if (slash && cg->pool_fd < 0) {
+        char pool[MAX_NAME_LEN];
+        snprintf(pool, sizeof(pool), "%.*s", (int)(slash - name), name);
+        if (mkdirat(root_fd, pool, 0755) != 0 && errno != EEXIST)
+            return fail(err, "mkdir", pool);
+        cg->pool_fd = openat(root_fd, pool, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (cg->pool_fd < 0) return fail(err, "open", pool);
+        enable_controllers(cg->pool_fd, pool, ~0u);
+        cg->pool_memory_max = cg->pool_cpu_quota = cg->pool_cpu_period = -1;
+    }
+
+    if (mkdirat(root_fd, name, 0755) != 0 && errno != EEXIST)
+        return fail(err, "mkdir", name);
+
+    cg->dirfd = openat(root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cg->dirfd < 0) return fail(err, "open", name);
+
+    snprintf(cg->name, sizeof(cg->name), "%s", name);
+    forget_applied(cg);
+    return 0;
 }
 
 
-static void apply_memory_limit(const char *program_path, long memory_bytes) {
-    if (memory_bytes <= 0) return;
+static int write_at(int dirfd, const char *file, const char *value, cgroup_error_t *err) {
+    int fd = openat(dirfd, file, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return fail(err, "open", file);
 
-    char mem_file[256];
-    snprintf(mem_file, sizeof(mem_file),
-             "%s/memory.max", program_path);
+    size_t len = strlen(value);
+    ssize_t n = write(fd, value, len);
+    int saved = errno;
+    close(fd);
 
-    char value[64];
-    snprintf(value, sizeof(value), "%ld", memory_bytes);
+    if (n != (ssize_t)len) {
+        errno = n < 0 ? saved : EIO;
+        return fail(err, "write", file);
+    }
+    return 0;
+}
 
-    write_file(mem_file, value);
+// one openat + one write per control file
+int cgroup_write(cgroup_t *cg, const char *file, const char *value, cgroup_error_t *err) {
+    return write_at(cg->dirfd, file, value, err);
 }
 
 
- // main setup function.
+// memory.max and cpu.max of one directory, each written only when it
+// differs from *memory_max / *cpu_quota + *cpu_period
+static int apply_limits(int dirfd, long memory, double cpu, long period,
+                        long *memory_max, long *cpu_quota, long *cpu_period, cgroup_error_t **err) {
+    char value[64];
+    int rc = 0;
 
-int cgroup_setup(program_config_t *p, pid_t pid) {
+    if (memory != *memory_max && (memory > 0 || *memory_max > 0)) {
+        if (memory > 0) snprintf(value, sizeof(value), "%ld", memory);
+        else snprintf(value, sizeof(value), "max");
+        if (write_at(dirfd, "memory.max", value, *err) != 0) {
+            rc = -1;
+            *err = NULL;
+        } else {
+            *memory_max = memory;
+        }
+    } else {
+        *memory_max = memory;
+    }
 
-    char supervisor_path[512];
-    char program_path[512];
+    long quota = cpu > 0 ? (long)(cpu * period) : 0; // 0.5 CPU at 100ms to 50000
+    if ((quota != *cpu_quota || (quota > 0 && period != *cpu_period)) &&
+        (quota > 0 || *cpu_quota > 0)) {
+        if (quota > 0) snprintf(value, sizeof(value), "%ld %ld", quota, period);
+        else snprintf(value, sizeof(value), "max %ld", period);
+        if (write_at(dirfd, "cpu.max", value, *err) != 0) {
+            rc = -1;
+            *err = NULL;
+        } else {
+            *cpu_quota = quota;
+            *cpu_period = period;
+        }
+    } else {
+        *cpu_quota = quota;
+        *cpu_period = period;
+    }
+    return rc;
+}
 
- 
-    snprintf(supervisor_path, sizeof(supervisor_path), "%s/%s", CGROUP_ROOT, SUPERVISOR_GROUP);
-    ensure_dir(supervisor_path);
+// single-value file, want < 0 = unset; a value we wrote before goes
+// back to dflt when the setting is dropped
+static int apply_value(cgroup_t *cg, const char *file, long want, long *have, const char *dflt,
+                       cgroup_error_t **err) {
+    char value[32];
 
-    int n = snprintf(program_path, sizeof(program_path),"%s/%s", supervisor_path, p->name);
-    if (n < 0 || n >= (int)sizeof(program_path))
-    {
-        fprintf(stderr, "Program name too long for cgroup path: %s\n", p->name);
+    if (want == *have || (want < 0 && *have < 0)) return 0;
+    if (want >= 0) snprintf(value, sizeof(value), "%ld", want);
+    else snprintf(value, sizeof(value), "%s", dflt);
+    if (cgroup_write(cg, file, value, *err) != 0) {
+        *err = NULL;
         return -1;
     }
-    ensure_dir(program_path);
+    *have = want;
+    return 0;
+}
 
-    // apply resource limits
-    apply_memory_limit(program_path, p->memory_limit_bytes);
-    apply_cpu_limit(program_path, p->cpu_limit);
+static int has_device(const char *lines, const char *dev, size_t len) {
+    for (const char *l = lines; *l; ) {
+        if (strncmp(l, dev, len) == 0 && l[len] == ' ') return 1;
+        l = strchr(l, '\n');
+        if (!l) break;
+        l++;
+    }
+    return 0;
+}
+
+// io.max / io.weight take one device per write: devices dropped since
+// the last apply are reset first, then every wanted line is written
+static int apply_io(cgroup_t *cg, const char *file, const char *want, char **have,
+                    const char *reset, cgroup_error_t **err) {
+    const char *old = *have ? *have : "";
+    char line[256];
+    int rc = 0;
+
+    if (strcmp(want, old) == 0) return 0;
+
+    for (const char *l = old; *l; ) {
+        const char *eol = strchr(l, '\n');
+        size_t dev = strcspn(l, " \n");
+        if (!has_device(want, l, dev)) {
+            if (dev == 7 && strncmp(l, "default", 7) == 0)
+                snprintf(line, sizeof(line), "default 100");
+            else
+                snprintf(line, sizeof(line), "%.*s %s", (int)dev, l, reset);
+            if (cgroup_write(cg, file, line, *err) != 0) {
+                rc = -1;
+                *err = NULL;
+            }
+        }
+        if (!eol) break;
+        l = eol + 1;
+    }
+
+    for (const char *l = want; *l; ) {
+        const char *eol = strchr(l, '\n');
+        size_t len = eol ? (size_t)(eol - l) : strlen(l);
+        snprintf(line, sizeof(line), "%.*s", (int)len, l);
+        if (cgroup_write(cg, file, line, *err) != 0) {
+            rc = -1;
+            *err = NULL;
+        }
+        if (!eol) break;
+        l = eol + 1;
+    }
 
-    // add process to cgroup
-    char procs_file[512];
-    n = snprintf(procs_file, sizeof(procs_file),"%s/cgroup.procs", program_path);
-    if (n < 0 || n >= (int)sizeof(procs_file)) {
-        fprintf(stderr, "Cgroup procs path too long for program: %s\n", p->name);
+    if (rc == 0) {
+        free(*have);
+        *have = want[0] ? strdup(want) : NULL;
+    }
+    return rc;
+}
+
+// cpuset.cpus / cpuset.mems; an empty list hands the parent's back
+static int apply_cpuset(cgroup_t *cg, const char *file, const char *want, char *have, size_t len,
+                        cgroup_error_t **err) {
+    if (strcmp(want, have) == 0) return 0;
+    if (cgroup_write(cg, file, want[0] ? want : "\n", *err) != 0) {
+        *err = NULL;
         return -1;
     }
+    snprintf(have, len, "%s", want);
+    return 0;
+}
+
+
+// write only the limits that differ from what the cgroup already has;
+// a failed write is retried next time, the first error is reported
+int cgroup_apply(cgroup_t *cg, const program_config_t *p, cgroup_error_t *err) {
+    int rc = 0;
+
+    long memory = p->memory_limit_bytes > 0 ? p->memory_limit_bytes : 0;
+    rc |= apply_limits(cg->dirfd, memory, p->cpu_limit, p->cpu_period_us,
+                       &cg->memory_max, &cg->cpu_quota, &cg->cpu_period, &err);
+
+    if (cg->pool_fd >= 0) {
+        long pool_memory = p->pool_memory_limit_bytes > 0 ? p->pool_memory_limit_bytes : 0;
+        rc |= apply_limits(cg->pool_fd, pool_memory, p->pool_cpu_limit, p->cpu_period_us,
+                           &cg->pool_memory_max, &cg->pool_cpu_quota, &cg->pool_cpu_period, &err);
+    }
+
+    rc |= apply_value(cg, "memory.high", p->memory_high_bytes, &cg->memory_high, "max", &err);
+    rc |= apply_value(cg, "memory.swap.max", p->memory_swap_max_bytes, &cg->swap_max, "max", &err);
+    rc |= apply_value(cg, "cpu.weight", p->cpu_weight, &cg->cpu_weight, "100", &err);
+    rc |= apply_value(cg, "pids.max", p->pids_max, &cg->pids_max, "max", &err);
+    rc |= apply_io(cg, "io.max", p->io_max, &cg->io_max, "rbps=max wbps=max riops=max wiops=max", &err);
+    rc |= apply_io(cg, "io.weight", p->io_weight, &cg->io_weight, "default", &err);
+
+    rc |= apply_cpuset(cg, "cpuset.cpus", p->cpu_affinity, cg->cpus, sizeof(cg->cpus), &err);
+    rc |= apply_cpuset(cg, "cpuset.mems", p->numa_node, cg->mems, sizeof(cg->mems), &err);
+    return rc;
+}
+
 
-    char pid_str[32];
-    snprintf(pid_str, sizeof(pid_str), "%d", pid);
+// keep memory.events open; the kernel flags it EPOLLPRI on every change
+int cgroup_watch_events(cgroup_t *cg, cgroup_error_t *err) {
+    if (cg->events_fd >= 0) return 0;
 
-    write_file(procs_file, pid_str);
+    cg->events_fd = openat(cg->dirfd, "memory.events", O_RDONLY | O_CLOEXEC);
+    if (cg->events_fd < 0) return fail(err, "open", "memory.events");
 
+    // baseline, so only kills from now on are attributed
+    return cgroup_read_oom_kills(cg, &cg->oom_kills);
+}
+
+
+int cgroup_read_oom_kills(cgroup_t *cg, uint64_t *count) {
+    char buf[512];
+    ssize_t n = pread(cg->events_fd, buf, sizeof(buf) - 1, 0);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+
+    const char *p = strstr(buf, "oom_kill ");
+    *count = p ? strtoull(p + 9, NULL, 10) : 0;
+    return 0;
+}
+
+
+// cgroup.events changes (EPOLLPRI) whenever the group empties, fills,
+// freezes or thaws
+int cgroup_watch_state(cgroup_t *cg, cgroup_error_t *err) {
+    if (cg->state_fd >= 0) return 0;
+
+    cg->state_fd = openat(cg->dirfd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (cg->state_fd < 0) return fail(err, "open", "cgroup.events");
     return 0;
 }
 
+int cgroup_read_state(cgroup_t *cg, int *populated, int *frozen) {
+    char buf[128];
+    ssize_t n = pread(cg->state_fd, buf, sizeof(buf) - 1, 0);
+    if (n < 0) return -1;
+    buf[n] = '\0';
 
-void cgroup_cleanup(const char *name) {
+    const char *p = strstr(buf, "populated ");
+    if (populated) *populated = p ? atoi(p + 10) : 0;
+    p = strstr(buf, "frozen ");
+    if (frozen) *frozen = p ? atoi(p + 7) : 0;
+    return 0;
+}
 
-    char path[256];
-    snprintf(path, sizeof(path),
-             "%s/%s/%s",
-             CGROUP_ROOT,
-             SUPERVISOR_GROUP,
-             name);
 
-    if (rmdir(path) != 0) {
-        perror("rmdir failed");
+// SIGKILL for the whole subtree in one write, setsid()'d descendants
+// included; before cgroup.kill (5.14) every listed process is killed
+// instead, a few passes to catch what forks meanwhile.
+// some kernels compare the kill sequence of the parent's cgroup with the
+// target's on CLONE_INTO_CGROUP, killing every later clone3 spawn into
+// a cgroup that was ever killed; cg->killed makes callers join through
+// cgroup.procs instead
+int cgroup_kill(cgroup_t *cg, cgroup_error_t *err) {
+    if (write_at(cg->dirfd, "cgroup.kill", "1", err) == 0) {
+        cg->killed = 1;
+        return 0;
+    }
+    if (errno != ENOENT) return -1;
+
+    for (int pass = 0; pass < 3; pass++) {
+        char buf[4096];
+        int fd = openat(cg->dirfd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return fail(err, "open", "cgroup.procs");
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (n < 0) return fail(err, "read", "cgroup.procs");
+        if (n == 0) return 0;
+        buf[n] = '\0';
+
+        char *save = NULL;
+        for (char *pid = strtok_r(buf, "\n", &save); pid; pid = strtok_r(NULL, "\n", &save))
+            kill((pid_t)atoi(pid), SIGKILL);
+    }
+    return 0;
+}
+
+
+// cgroup.freeze: 1 stops every task in the group, 0 lets them run
+int cgroup_freeze(cgroup_t *cg, int frozen, cgroup_error_t *err) {
+    return write_at(cg->dirfd, "cgroup.freeze", frozen ? "1" : "0", err);
+}
+
+// memory.high at 90% of memory.current (never below SQUEEZE_FLOOR), so
+// the kernel reclaims and slows the group's allocations down without
+// the oom killer. memory_high records it, so the next cgroup_apply puts
+// the configured value (or "max") back
+int cgroup_squeeze_memory(cgroup_t *cg, cgroup_error_t *err) {
+    char buf[32];
+    int fd = openat(cg->dirfd, "memory.current", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return fail(err, "open", "memory.current");
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return fail(err, "read", "memory.current");
+    buf[n] = '\0';
+
+    long high = strtol(buf, NULL, 10) / 10 * 9;
+    if (high < SQUEEZE_FLOOR) high = SQUEEZE_FLOOR;
+    if (cg->memory_high >= 0 && high >= cg->memory_high) return 0;   // already tighter
+    snprintf(buf, sizeof(buf), "%ld", high);
+    if (write_at(cg->dirfd, "memory.high", buf, err) != 0) return -1;
+    cg->memory_high = high;
+    return 0;
+}
+
+// move every process of from into to; frozen ones thaw as they land.
+// a second pass picks up anything forked while the first ran
+int cgroup_migrate(cgroup_t *from, cgroup_t *to, cgroup_error_t *err) {
+    for (int pass = 0; pass < 2; pass++) {
+        char buf[4096];
+        int fd = openat(from->dirfd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return fail(err, "open", "cgroup.procs");
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (n < 0) return fail(err, "read", "cgroup.procs");
+        if (n == 0) return 0;
+        buf[n] = '\0';
+
+        char *save = NULL;
+        for (char *pid = strtok_r(buf, "\n", &save); pid; pid = strtok_r(NULL, "\n", &save)) {
+            // ESRCH: exited since the read
+            if (write_at(to->dirfd, "cgroup.procs", pid, err) != 0 && errno != ESRCH)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+
+// rmdir failures come back in err; the handle is closed either way
+int cgroup_close(cgroup_t *cg, int remove, cgroup_error_t *err) {
+    int rc = 0;
+    if (cg->events_fd >= 0) close(cg->events_fd);
+    cg->events_fd = -1;
+    if (cg->state_fd >= 0) close(cg->state_fd);
+    cg->state_fd = -1;
+    cg->killed = 0;
+    forget_applied(cg);
+    if (cg->dirfd >= 0) {
+        close(cg->dirfd);
+        cg->dirfd = -1;
+
+        if (remove && root_fd >= 0 && unlinkat(root_fd, cg->name, AT_REMOVEDIR) != 0 && errno != ENOENT)
+            rc = fail(err, "rmdir", cg->name);
+    }
+
+    // the last instance out takes the pool with it
+    if (cg->pool_fd >= 0) {
+        close(cg->pool_fd);
+        cg->pool_fd = -1;
+        char *slash = strchr(cg->name, '/');
+        if (remove && root_fd >= 0 && slash) {
+            *slash = '\0';
+            // EBUSY while others remain
+            if (unlinkat(root_fd, cg->name, AT_REMOVEDIR) != 0 && errno != EBUSY && errno != ENOENT && rc == 0)
+                rc = fail(err, "rmdir", cg->name);
+        }
     }
+    return rc;
 }
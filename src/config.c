@@ -1,27 +1,69 @@
 #include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <unistd.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
 
-#define LINE_LEN 512
+#define MAX_INCLUDE_DEPTH 8
+#define MAX_KEY_LEN 64
+#define DEFAULT_LOG_MAXBYTES (50L * 1024 * 1024)
+#define DEFAULT_LOG_BACKUPS 10
+#define DEFAULT_SAMPLE_INTERVAL 5
+#define DEFAULT_METRICS_INTERVAL 10
+#define DEFAULT_OOM_BACKOFF_FACTOR 2.0
+#define DEFAULT_OOM_BACKOFF_MAX 300
+#define DEFAULT_STOP_TIMEOUT 3
+#define DEFAULT_HEALTH_INTERVAL 10
+#define DEFAULT_HEALTH_TIMEOUT 5
+#define DEFAULT_HEALTH_RETRIES 3
+#define MAX_NUMPROCS 1024
+#define MAX_CPU_ID 4095
+#define PROCESS_NUM "%(process_num)"
+#define DEFAULT_CPU_PERIOD_US 100000
+#define DEFAULT_PRESSURE_COOLDOWN 30
 
-// trim leading/trailing whitespace
-static void trim(char *str) {
-    // leading
-    char *start = str;
-    while (*start && isspace((unsigned char)*start))
-        start++;
-    if (start != str)
-        memmove(str, start, strlen(start) + 1);
+static const struct { const char *name; int sig; } signal_names[] = {
+    {"SIGHUP", SIGHUP}, {"SIGINT", SIGINT}, {"SIGQUIT", SIGQUIT}, {"SIGKILL", SIGKILL},
+    {"SIGUSR1", SIGUSR1}, {"SIGUSR2", SIGUSR2}, {"SIGTERM", SIGTERM},
+    {"SIGSTOP", SIGSTOP}, {"SIGCONT", SIGCONT}, {"SIGWINCH", SIGWINCH},
+};
 
-    // trailing
-    char *end = str + strlen(str) - 1;
-    while (end >= str && isspace((unsigned char)*end))
-        end--;
-    *(end + 1) = '\0';
+// "TERM", "SIGTERM" or "15"; -1 if unknown
+int parse_signal(const char *s) {
+    char *end;
+    long n = strtol(s, &end, 10);
+    if (*s && *end == '\0')
+        return (n > 0 && n < NSIG) ? (int)n : -1;
+
+    if (strncasecmp(s, "SIG", 3) == 0) s += 3;
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++) {
+        if (strcasecmp(s, signal_names[i].name + 3) == 0)
+            return signal_names[i].sig;
+    }
+    return -1;
 }
 
+const char *signal_str(int sig) {
+    for (size_t i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++) {
+        if (signal_names[i].sig == sig)
+            return signal_names[i].name;
+    }
+    return "UNKNOWN";
+}
 
 static int parse_bool(const char *value, bool *out) {
     if (strcasecmp(value, "true") == 0) { *out = true; return 0; }
@@ -37,6 +79,39 @@ static int parse_restart_policy(const char *value, restart_policy_t *out) {
     return -1;
 }
 
+// cpu/node list as cpuset takes it: "0-3,6,8-9"; fills out[] up to max
+// and returns the total count, -1 on a syntax error
+int parse_cpu_list(const char *s, int *out, int max) {
+    int n = 0;
+
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s || lo < 0 || lo > MAX_CPU_ID) return -1;
+        s = end;
+        if (*s == '-') {
+            hi = strtol(s + 1, &end, 10);
+            if (end == s + 1 || hi < lo || hi > MAX_CPU_ID) return -1;
+            s = end;
+        }
+        for (long c = lo; c <= hi; c++, n++) {
+            if (out && n < max) out[n] = (int)c;
+        }
+        if (*s == ',') s++;
+        else if (*s) return -1;
+    }
+    return n > 0 ? n : -1;
+}
+
+static int parse_health_type(const char *value, health_type_t *out) {
+    if (strcasecmp(value, "none") == 0) { *out = HEALTH_NONE; return 0; }
+    if (strcasecmp(value, "exec") == 0) { *out = HEALTH_EXEC; return 0; }
+    if (strcasecmp(value, "tcp") == 0) { *out = HEALTH_TCP; return 0; }
+    if (strcasecmp(value, "http") == 0) { *out = HEALTH_HTTP; return 0; }
+    if (strcasecmp(value, "file") == 0) { *out = HEALTH_FILE; return 0; }
+    return -1;
+}
+
 //memory parser
 int parse_memory(const char *value, long *result) {
     char unit[3] = {0};
@@ -78,130 +153,1369 @@ int parse_cpu(const char *value, double *result) {
 
 
 
-// load config
-int load_config(const char *filename, supervisor_config_t *config) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        perror("Failed to open config file");
-        return -1;
+// growable byte buffer for building argv strings
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+static int sb_putc(strbuf_t *b, char c) {
+    if (b->len == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 128;
+        char *d = realloc(b->data, cap);
+        if (!d) return -1;
+        b->data = d;
+        b->cap = cap;
     }
+    b->data[b->len++] = c;
+    return 0;
+}
 
-    char line[LINE_LEN];
-    program_config_t *current = NULL;
-    size_t line_number = 0;
-    int in_program = 0;
+static int sb_puts(strbuf_t *b, const char *s) {
+    while (*s)
+        if (sb_putc(b, *s++) != 0) return -1;
+    return 0;
+}
 
-    config->count = 0;
+// expand $VAR / ${VAR} at *pp (pointing at '$'), unset vars expand to ""
+static int expand_var(strbuf_t *b, const char **pp) {
+    const char *s = *pp + 1;
+    char name[128];
+    size_t n = 0;
+    int braced = (*s == '{');
+    if (braced) s++;
+
+    while ((isalnum((unsigned char)*s) || *s == '_') && n < sizeof(name) - 1)
+        name[n++] = *s++;
+    name[n] = '\0';
+
+    if (braced) {
+        if (*s != '}') return -1;
+        s++;
+    }
+    if (n == 0) {   // lone '$' stays literal
+        *pp += 1;
+        return sb_putc(b, '$');
+    }
+
+    const char *val = getenv(name);
+    *pp = s;
+    return val ? sb_puts(b, val) : 0;
+}
+
+// split a command into NUL-separated words: '...' is literal, "..." allows
+// $VAR and \ escapes, bare words expand $VAR. returns 1 on shell syntax
+// (pipes, redirects, globs, $(...)), which only /bin/sh can run
+static int split_command(const char *cmd, strbuf_t *b, size_t *argc, const char **err) {
+    const char *s = cmd;
+    *argc = 0;
+
+    for (;;) {
+        while (isspace((unsigned char)*s)) s++;
+        if (!*s) return 0;
+
+        for (;;) {
+            char c = *s;
+            if (!c || isspace((unsigned char)c)) break;
+
+            if (c == '\'') {
+                const char *end = strchr(s + 1, '\'');
+                if (!end) { *err = "unterminated single quote"; return -1; }
+                for (s++; s < end; s++)
+                    if (sb_putc(b, *s) != 0) return -1;
+                s++;
+            } else if (c == '"') {
+                for (s++; *s && *s != '"'; ) {
+                    if (*s == '\\' && s[1] && strchr("\\\"$`", s[1])) {
+                        if (sb_putc(b, s[1]) != 0) return -1;
+                        s += 2;
+                    } else if (*s == '$') {
+                        if (expand_var(b, &s) != 0) { *err = "bad variable reference"; return -1; }
+                    } else if (sb_putc(b, *s++) != 0) {
+                        return -1;
+                    }
+                }
+                if (*s != '"') { *err = "unterminated double quote"; return -1; }
+                s++;
+            } else if (c == '\\' && s[1]) {
+                if (sb_putc(b, s[1]) != 0) return -1;
+                s += 2;
+            } else if (c == '$') {
+                if (s[1] == '(') return 1;
+                if (expand_var(b, &s) != 0) { *err = "bad variable reference"; return -1; }
+            } else if (strchr("|&;<>()`*?", c)) {
+                return 1;
+            } else {
+                if (sb_putc(b, c) != 0) return -1;
+                s++;
+            }
+        }
+        if (sb_putc(b, '\0') != 0) return -1;
+        (*argc)++;
+    }
+}
+
+// pointer -> pointer map for interned strings (pointer equality is
+// string equality), used for duplicate names and tokenizer caches
+typedef struct {
+    const void **keys;
+    void **vals;
+    size_t cap;       // power of two
+    size_t len;
+} ptrmap_t;
+
+static size_t ptr_bucket(const ptrmap_t *m, const void *k) {
+    return (size_t)(((uintptr_t)k >> 3) * 0x9E3779B97F4A7C15ull) & (m->cap - 1);
+}
+
+static void *ptrmap_get(const ptrmap_t *m, const void *k) {
+    if (m->cap == 0) return NULL;
+    for (size_t b = ptr_bucket(m, k); m->keys[b]; b = (b + 1) & (m->cap - 1)) {
+        if (m->keys[b] == k) return m->vals[b];
+    }
+    return NULL;
+}
+
+static int ptrmap_put(ptrmap_t *m, const void *k, void *v) {
+    if (m->len * 2 >= m->cap) {
+        ptrmap_t g = { .cap = m->cap ? m->cap * 2 : 256 };
+        g.keys = calloc(g.cap, sizeof(void *));
+        g.vals = malloc(g.cap * sizeof(void *));
+        if (!g.keys || !g.vals) {
+            free(g.keys);
+            free(g.vals);
+            return -1;
+        }
+        for (size_t i = 0; i < m->cap; i++) {
+            if (m->keys[i]) ptrmap_put(&g, m->keys[i], m->vals[i]);
+        }
+        free(m->keys);
+        free(m->vals);
+        *m = g;
+    }
+    size_t b = ptr_bucket(m, k);
+    while (m->keys[b] && m->keys[b] != k) b = (b + 1) & (m->cap - 1);
+    if (!m->keys[b]) m->len++;
+    m->keys[b] = k;
+    m->vals[b] = v;
+    return 0;
+}
+
+static void ptrmap_free(ptrmap_t *m) {
+    free(m->keys);
+    free(m->vals);
+    memset(m, 0, sizeof(*m));
+}
+
+
+// resolve argv[0] against PATH once, so restarts exec the binary directly
+static const char *resolve_exec_path(arena_t *a, const char *file) {
+    if (strchr(file, '/')) return file;
+
+    const char *path = getenv("PATH");
+    if (!path) path = "/usr/local/bin:/usr/bin:/bin";
+
+    char candidate[4096];
+    while (*path) {
+        const char *sep = strchr(path, ':');
+        size_t len = sep ? (size_t)(sep - path) : strlen(path);
+        int n = snprintf(candidate, sizeof(candidate), "%.*s/%s",
+                         (int)len, len ? path : ".", file);
+        if (n > 0 && n < (int)sizeof(candidate) && access(candidate, X_OK) == 0)
+            return arena_intern(a, candidate, (size_t)n);
+        path += len;
+        if (*path == ':') path++;
+    }
+    return file;   // exec will report it
+}
+
+
+// parser state, shared across included files
+typedef struct {
+    supervisor_config_t *config;
+    program_config_t *current;   // always the last program while in its block
+    int in_global;
+    const char *file;            // interned, for messages
+    unsigned line;
+    int depth;
+    ptrmap_t names;              // interned name -> program index + 1
+    ptrmap_t commands;           // interned command -> program already tokenized
+    ptrmap_t execs;              // interned argv[0] -> resolved exec path
+    strbuf_t value;              // NUL-terminated copy of the current value
+    strbuf_t words;              // split_command output
+} parser_t;
+
+static int fail(parser_t *ps, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static int fail(parser_t *ps, const char *fmt, ...) {
+    va_list ap;
+    fprintf(stderr, "%s:%u: ", ps->file, ps->line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    return -1;
+}
+
+static int fail_at(const program_config_t *p, const char *fmt, const char *detail) {
+    fprintf(stderr, "%s:%u: program '%s': ", p->file, p->line, p->name);
+    fprintf(stderr, fmt, detail);
+    fputc('\n', stderr);
+    return -1;
+}
+
+// each probe kind needs its own target
+static int check_health(program_config_t *p) {
+    switch (p->health_type) {
+    case HEALTH_EXEC:
+        if (!p->health_command[0]) return fail_at(p, "%s", "healthcheck=exec needs healthcheck_command");
+        break;
+    case HEALTH_HTTP:
+        if (!p->health_path[0]) p->health_path = "/";
+        // fall through
+    case HEALTH_TCP:
+        if (!p->health_port) return fail_at(p, "%s", "healthcheck needs healthcheck_port");
+        break;
+    case HEALTH_FILE:
+        if (!p->health_path[0]) return fail_at(p, "%s", "healthcheck=file needs healthcheck_path");
+        break;
+    case HEALTH_NONE:
+        break;
+    }
+    return 0;
+}
+
+
+// build p->argv in the arena; identical commands share one argv and
+// one PATH lookup
+static int tokenize_command(parser_t *ps, program_config_t *p) {
+    arena_t *a = &ps->config->arena;
+
+    program_config_t *seen = ptrmap_get(&ps->commands, p->command);
+    if (seen) {
+        p->argv = seen->argv;
+        p->exec_path = seen->exec_path;
+        return 0;
+    }
+
+    size_t argc = 0;
+    const char *err = "out of memory";
+    ps->words.len = 0;
+    int rc = split_command(p->command, &ps->words, &argc, &err);
+    if (rc == 1) {
+        // these always ran through the shell; keep them working
+        fprintf(stderr, "%s:%u: program '%s': shell syntax in command, running it with /bin/sh -c "
+                "(set shell=true to say so)\n", p->file, p->line, p->name);
+        p->shell = true;
+        return 0;
+    }
+    if (rc != 0 || argc == 0) {
+        if (argc == 0 && ps->words.len == 0) err = "empty command";
+        return fail_at(p, "%s in command", err);
+    }
+
+    char **argv = arena_alloc(a, (argc + 1) * sizeof(char *));
+    if (!argv) return fail_at(p, "%s", "out of memory");
+
+    const char *w = ps->words.data;
+    for (size_t i = 0; i < argc; i++) {
+        size_t len = strlen(w);
+        argv[i] = (char *)arena_intern(a, w, len);
+        if (!argv[i]) return fail_at(p, "%s", "out of memory");
+        w += len + 1;
+    }
+    argv[argc] = NULL;
+    p->argv = argv;
+
+    p->exec_path = ptrmap_get(&ps->execs, argv[0]);
+    if (!p->exec_path) {
+        p->exec_path = resolve_exec_path(a, argv[0]);
+        if (!p->exec_path || ptrmap_put(&ps->execs, argv[0], (void *)p->exec_path) != 0)
+            return fail_at(p, "%s", "out of memory");
+    }
+    return ptrmap_put(&ps->commands, p->command, p);
+}
+
+
+static const char *intern_value(parser_t *ps) {
+    return arena_intern(&ps->config->arena, ps->value.data, ps->value.len);
+}
+
+// keys of the "supervisor" block
+static int parse_global(parser_t *ps, const char *key, const char *value) {
+    supervisor_config_t *config = ps->config;
+    char *end;
+
+    if (strcasecmp(key, "sample_interval") == 0) {
+        long v = strtol(value, &end, 10);
+        if (*end != '\0' || v < 0) return -1;
+        config->sample_interval = (int)v;
+        return 0;
+    }
+    if (strcasecmp(key, "control_socket") == 0) {
+        // "none" turns the control socket off
+        config->control_socket = strcasecmp(value, "none") == 0 ? "" : intern_value(ps);
+        return config->control_socket ? 0 : -1;
+    }
+    if (strcasecmp(key, "metrics_file") == 0) {
+        config->metrics_file = strcasecmp(value, "none") == 0 ? "" : intern_value(ps);
+        return config->metrics_file ? 0 : -1;
+    }
+    if (strcasecmp(key, "metrics_interval") == 0) {
+        long v = strtol(value, &end, 10);
+        if (*end != '\0' || v <= 0) return -1;
+        config->metrics_interval = (int)v;
+        return 0;
+    }
+    if (strcasecmp(key, "freeze_memory_pressure") == 0 || strcasecmp(key, "freeze_cpu_pressure") == 0) {
+        double v = strtod(value, &end);
+        if (end == value || *end != '\0' || v < 0 || v > 100) return -1;
+        if (strcasecmp(key, "freeze_memory_pressure") == 0) config->freeze_memory_pressure = v;
+        else config->freeze_cpu_pressure = v;
+        return 0;
+    }
+    return -1;
+}
+
+
+static program_config_t *new_program(parser_t *ps, const char *name, size_t len) {
+    supervisor_config_t *config = ps->config;
+
+    if (config->count == config->capacity) {
+        size_t cap = config->capacity ? config->capacity * 2 : 16;
+        program_config_t *grown = realloc(config->programs, cap * sizeof(program_config_t));
+        if (!grown) return NULL;
+        config->programs = grown;
+        config->capacity = cap;
+    }
+
+    program_config_t *p = &config->programs[config->count++];
+    memset(p, 0, sizeof(program_config_t));
+    p->name = arena_intern(&config->arena, name, len);
+    p->file = ps->file;
+    p->line = ps->line;
+    if (!p->name) return NULL;
+
+    // defaults
+    p->command = "";
+    p->depends_on = "";
+    p->stdout_path = "";
+    p->stderr_path = "";
+    p->autostart = true;
+    p->autorestart = RESTART_NEVER;
+    p->restart_delay = 0;
+    p->restart_mode = RESTART_MODE_STOP_START;
+    p->standby = false;
+    p->standby_freeze = false;
+    p->freeze_on_pressure = false;
+    p->pressure_count = 0;
+    p->pressure_cooldown = DEFAULT_PRESSURE_COOLDOWN;
+    p->max_restarts = 0;
+    p->backoff_factor = 1.0;
+    p->backoff_max = 0;
+    p->backoff_jitter = 0.2;
+    p->oom_restart = -1;          // resolved after parsing
+    p->oom_restart_delay = -1;
+    p->oom_backoff_factor = DEFAULT_OOM_BACKOFF_FACTOR;
+    p->oom_backoff_max = DEFAULT_OOM_BACKOFF_MAX;
+    p->stdout_maxbytes = DEFAULT_LOG_MAXBYTES;
+    p->stdout_backups = DEFAULT_LOG_BACKUPS;
+    p->stderr_maxbytes = DEFAULT_LOG_MAXBYTES;
+    p->stderr_backups = DEFAULT_LOG_BACKUPS;
+    p->stop_signal = SIGTERM;
+    p->stop_timeout = DEFAULT_STOP_TIMEOUT;
+    p->priority = 0;
+    p->health_command = "";
+    p->health_host = "127.0.0.1";
+    p->health_path = "";
+    p->health_interval = DEFAULT_HEALTH_INTERVAL;
+    p->health_timeout = DEFAULT_HEALTH_TIMEOUT;
+    p->health_retries = DEFAULT_HEALTH_RETRIES;
+    p->cpu_period_us = DEFAULT_CPU_PERIOD_US;
+    p->memory_high_bytes = -1;
+    p->memory_swap_max_bytes = -1;
+    p->cpu_weight = -1;
+    p->pids_max = -1;
+    p->io_max = "";
+    p->io_weight = "";
+    p->listen = "";
+    p->numprocs = 1;
+    p->pool = "";
+    p->cpu_affinity = "";
+    p->numa_node = "";
+    return p;
+}
+
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
 
-    while (fgets(line, sizeof(line), fp)) {
-        line_number++;
-        trim(line);
 
-        // skip blank lines and comments
-        if (line[0] == '\0' || line[0] == '#')
+// MAJ:MIN, or a block device path resolved to its numbers
+static int parse_device(const char *s, size_t len, unsigned *maj, unsigned *min) {
+    char dev[256];
+    if (len >= sizeof(dev)) return -1;
+    memcpy(dev, s, len);
+    dev[len] = '\0';
+
+    if (dev[0] == '/') {
+        struct stat st;
+        if (stat(dev, &st) != 0 || !S_ISBLK(st.st_mode)) return -1;
+        *maj = major(st.st_rdev);
+        *min = minor(st.st_rdev);
+        return 0;
+    }
+    char *end;
+    *maj = (unsigned)strtoul(dev, &end, 10);
+    if (end == dev || *end != ':') return -1;
+    const char *m = end + 1;
+    *min = (unsigned)strtoul(m, &end, 10);
+    return end == m || *end ? -1 : 0;
+}
+
+// io_max / io_weight: ';'-separated entries "<dev> rbps=10MB wiops=max"
+// or "<dev> <weight>", io_weight also takes a bare default weight;
+// stored one line per device, the way the kernel takes them
+static int parse_io(parser_t *ps, const char *value, int weight, const char **out) {
+    static const char *const io_keys[] = { "rbps", "wbps", "riops", "wiops" };
+    strbuf_t b = {0};
+    const char *s = value;
+    int rc = 0;
+
+    while (*s && rc == 0) {
+        const char *end = strchr(s, ';');
+        if (!end) end = s + strlen(s);
+        while (s < end && is_space(*s)) s++;
+        const char *tok = s;
+        while (s < end && !is_space(*s)) s++;
+        const char *tok_end = s;
+        if (tok == tok_end) {   // empty entry
+            s = *end ? end + 1 : end;
             continue;
+        }
+
+        unsigned maj, min;
+        char line[160];
+        int n;
+        if (weight && isdigit((unsigned char)*tok) && !memchr(tok, ':', (size_t)(tok_end - tok))) {
+            long w = strtol(tok, NULL, 10);
+            n = snprintf(line, sizeof(line), "default %ld", w);
+            if (w < 1 || w > 10000) rc = fail(ps, "invalid io_weight %ld (1-10000)", w);
+        } else if (parse_device(tok, (size_t)(tok_end - tok), &maj, &min) != 0) {
+            rc = fail(ps, "invalid device '%.*s' (MAJ:MIN or a block device)", (int)(tok_end - tok), tok);
+            break;
+        } else {
+            n = snprintf(line, sizeof(line), "%u:%u", maj, min);
+        }
 
-        // program block
-        if (strncmp(line, "program ", 8) == 0) {
-            if (config->count >= MAX_PROGRAMS) {
-                fprintf(stderr, "Line %zu: too many programs\n", line_number);
-                fclose(fp);
-                return -1;
+        // the rest of the entry: one weight, or key=value limits
+        int fields = 0;
+        while (rc == 0) {
+            while (s < end && is_space(*s)) s++;
+            if (s == end) break;
+            const char *f = s;
+            while (s < end && !is_space(*s)) s++;
+            char field[64];
+            snprintf(field, sizeof(field), "%.*s", (int)(s - f), f);
+            fields++;
+
+            if (weight) {
+                long w = strtol(field, NULL, 10);
+                if (fields > 1 || strncmp(line, "default", 7) == 0 || w < 1 || w > 10000)
+                    rc = fail(ps, "invalid io_weight entry '%.*s'", (int)(end - tok), tok);
+                else
+                    n += snprintf(line + n, sizeof(line) - (size_t)n, " %ld", w);
+                continue;
+            }
+
+            char *eq = strchr(field, '=');
+            size_t k = 0;
+            while (eq && k < 4 && (strlen(io_keys[k]) != (size_t)(eq - field) ||
+                                   strncmp(field, io_keys[k], (size_t)(eq - field)) != 0))
+                k++;
+            const char *val = eq ? eq + 1 : "";
+            long v = -1;   // max
+            int bad = !eq || k == 4;
+            if (!bad && strcmp(val, "max") != 0) {
+                if (k < 2) {   // bytes per second, KB/MB/GB allowed
+                    bad = parse_memory(val, &v) != 0;
+                } else {
+                    char *e;
+                    v = strtol(val, &e, 10);
+                    bad = e == val || *e || v <= 0;
+                }
             }
+            if (bad) {
+                rc = fail(ps, "invalid io_max field '%s' (rbps, wbps, riops, wiops)", field);
+                break;
+            }
+            if (v < 0)
+                n += snprintf(line + n, sizeof(line) - (size_t)n, " %s=max", io_keys[k]);
+            else
+                n += snprintf(line + n, sizeof(line) - (size_t)n, " %s=%ld", io_keys[k], v);
+        }
+        if (rc == 0 && fields == 0 && strncmp(line, "default", 7) != 0)
+            rc = fail(ps, "io entry '%.*s' has no %s", (int)(tok_end - tok), tok, weight ? "weight" : "limits");
+        if (rc == 0 && (sb_puts(&b, line) != 0 || sb_putc(&b, '\n') != 0))
+            rc = fail(ps, "out of memory");
+        s = *end ? end + 1 : end;
+    }
+
+    if (rc == 0) {
+        *out = b.len ? arena_intern(&ps->config->arena, b.data, b.len) : "";
+        if (!*out) rc = fail(ps, "out of memory");
+    }
+    free(b.data);
+    return rc;
+}
+
+// listen: ','-separated "tcp:HOST:PORT" (IPv4, localhost or *) or
+// "unix:/path", normalized to one "tcp:ADDR:PORT" / "unix:/path" per line
+static int parse_listen(parser_t *ps, const char *value, const char **out) {
+    strbuf_t b = {0};
+    const char *s = value;
+    int rc = 0;
+
+    while (*s && rc == 0) {
+        const char *end = strchr(s, ',');
+        if (!end) end = s + strlen(s);
+        while (s < end && is_space(*s)) s++;
+        const char *e = end;
+        while (e > s && is_space(e[-1])) e--;
+        const char *entry = s;
+        int entry_len = (int)(e - s);
+        char tok[160], line[160];
+        s = *end ? end + 1 : end;
+        if (entry_len == 0) continue;
+        // never store (and later bind) a spec cut short
+        if (snprintf(tok, sizeof(tok), "%.*s", entry_len, entry) >= (int)sizeof(tok)) {
+            rc = fail(ps, "listen '%.*s' is too long", entry_len, entry);
+            break;
+        }
+
+        if (strncmp(tok, "unix:", 5) == 0) {
+            if (tok[5] != '/' || strlen(tok + 5) >= sizeof(((struct sockaddr_un *)0)->sun_path))
+                rc = fail(ps, "invalid listen '%s' (unix: needs an absolute path under 108 bytes)", tok);
+            else if (snprintf(line, sizeof(line), "%s", tok) >= (int)sizeof(line))
+                rc = fail(ps, "listen '%s' is too long", tok);
+        } else if (strncmp(tok, "tcp:", 4) == 0) {
+            char *colon = strrchr(tok + 4, ':');
+            char *port_end = NULL;
+            long port = colon ? strtol(colon + 1, &port_end, 10) : 0;
+            struct in_addr addr;
+            if (colon) *colon = '\0';
+            const char *host = tok + 4;
+            if (strcmp(host, "*") == 0) host = "0.0.0.0";
+            else if (strcasecmp(host, "localhost") == 0) host = "127.0.0.1";
+            if (!colon || port_end == colon + 1 || *port_end || port <= 0 || port > 65535 ||
+                inet_pton(AF_INET, host, &addr) != 1)
+                rc = fail(ps, "invalid listen '%.*s' (tcp:HOST:PORT with an IPv4 host)", entry_len, entry);
+            else if (snprintf(line, sizeof(line), "tcp:%s:%ld", host, port) >= (int)sizeof(line))
+                rc = fail(ps, "listen '%.*s' is too long", entry_len, entry);
+        } else {
+            rc = fail(ps, "invalid listen '%s' (tcp:HOST:PORT or unix:/path)", tok);
+        }
+        if (rc == 0 && (sb_puts(&b, line) != 0 || sb_putc(&b, '\n') != 0))
+            rc = fail(ps, "out of memory");
+    }
+
+    if (rc == 0) {
+        *out = b.len ? arena_intern(&ps->config->arena, b.data, b.len) : "";
+        if (!*out) rc = fail(ps, "out of memory");
+    }
+    free(b.data);
+    return rc;
+}
+
+
+// "150ms" or "1s"
+static int parse_ms(const char *s, int *out) {
+    char *end;
+    long v = strtol(s, &end, 10);
+    if (end == s || v <= 0) return -1;
+    if (strcasecmp(end, "ms") == 0) *out = (int)v;
+    else if (strcasecmp(end, "s") == 0 && v <= 10) *out = (int)v * 1000;
+    else return -1;
+    return 0;
+}
+
+// pressure_trigger: ','-separated "RESOURCE some|full STALL WINDOW ACTION",
+// e.g. "memory some 150ms 1s throttle, cpu full 500ms 2s log"
+static int parse_pressure(parser_t *ps, const char *value, program_config_t *p) {
+    static const char *const resources[] = { "memory", "cpu", "io" };
+    static const char *const actions[] = { "log", "throttle", "freeze", "restart" };
+    const char *s = value;
+
+    p->pressure_count = 0;
+    while (*s) {
+        const char *end = strchr(s, ',');
+        if (!end) end = s + strlen(s);
+        char entry[128], res[16], kind[8], stall[16], window[16], action[16], extra[2];
+        snprintf(entry, sizeof(entry), "%.*s", (int)(end - s), s);
+        s = *end ? end + 1 : end;
+
+        int n = sscanf(entry, "%15s %7s %15s %15s %15s %1s", res, kind, stall, window, action, extra);
+        if (n <= 0) continue;   // empty entry
+        if (n != 5)
+            return fail(ps, "invalid pressure_trigger '%s' (RESOURCE some|full STALL WINDOW ACTION)", entry);
+        if (p->pressure_count == MAX_PRESSURE_TRIGGERS)
+            return fail(ps, "more than %d pressure triggers", MAX_PRESSURE_TRIGGERS);
 
-            current = &config->programs[config->count++];
-            memset(current, 0, sizeof(program_config_t));
+        pressure_trigger_t *t = &p->pressure[p->pressure_count];
+        size_t r = 0, a = 0;
+        while (r < 3 && strcasecmp(res, resources[r]) != 0) r++;
+        while (a < 4 && strcasecmp(action, actions[a]) != 0) a++;
+        if (r == 3) return fail(ps, "unknown pressure resource '%s' (memory, cpu or io)", res);
+        if (a == 4) return fail(ps, "unknown pressure action '%s' (log, throttle, freeze or restart)", action);
+        if (strcasecmp(kind, "some") != 0 && strcasecmp(kind, "full") != 0)
+            return fail(ps, "invalid pressure kind '%s' (some or full)", kind);
+        if (parse_ms(stall, &t->stall_ms) != 0 || parse_ms(window, &t->window_ms) != 0 ||
+            t->window_ms < 500 || t->window_ms > 10000 || t->stall_ms > t->window_ms)
+            return fail(ps, "invalid pressure window in '%s' (STALL <= WINDOW, window 500ms-10s)", entry);
+        if (a == PRESSURE_THROTTLE && r != PRESSURE_MEMORY)
+            return fail(ps, "throttle only applies to memory pressure");
+        t->resource = (pressure_resource_t)r;
+        t->full = strcasecmp(kind, "full") == 0;
+        t->action = (pressure_action_t)a;
+        p->pressure_count++;
+    }
+    return 0;
+}
+
+
+static int parse_program_key(parser_t *ps, const char *key, const char *value) {
+    program_config_t *current = ps->current;
+
+    if (strcasecmp(key, "command") == 0) {
+        if (!(current->command = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "shell") == 0) {
+        if (parse_bool(value, &current->shell) != 0)
+            return fail(ps, "invalid boolean for shell");
+    } else if (strcasecmp(key, "autostart") == 0) {
+        if (parse_bool(value, &current->autostart) != 0)
+            return fail(ps, "invalid boolean for autostart");
+    } else if (strcasecmp(key, "autorestart") == 0) {
+        if (parse_restart_policy(value, &current->autorestart) != 0)
+            return fail(ps, "invalid restart policy");
+    } else if (strcasecmp(key, "restart_delay") == 0) {
+        current->restart_delay = atoi(value);
+    } else if (strcasecmp(key, "restart_mode") == 0) {
+        if (strcasecmp(value, "rolling") == 0) current->restart_mode = RESTART_MODE_ROLLING;
+        else if (strcasecmp(value, "stop-start") == 0) current->restart_mode = RESTART_MODE_STOP_START;
+        else return fail(ps, "invalid restart_mode '%s' (stop-start or rolling)", value);
+    } else if (strcasecmp(key, "standby") == 0) {
+        // one warm spare; more would only add memory, not speed
+        if (strcmp(value, "0") == 0) current->standby = false;
+        else if (strcmp(value, "1") == 0) current->standby = true;
+        else return fail(ps, "invalid standby '%s' (0 or 1)", value);
+    } else if (strcasecmp(key, "standby_freeze") == 0) {
+        if (parse_bool(value, &current->standby_freeze) != 0)
+            return fail(ps, "invalid boolean for standby_freeze");
+    } else if (strcasecmp(key, "freeze_on_pressure") == 0) {
+        if (parse_bool(value, &current->freeze_on_pressure) != 0)
+            return fail(ps, "invalid boolean for freeze_on_pressure");
+    } else if (strcasecmp(key, "pressure_trigger") == 0) {
+        return parse_pressure(ps, value, current);
+    } else if (strcasecmp(key, "pressure_cooldown") == 0) {
+        char *end;
+        long v = strtol(value, &end, 10);
+        if (end == value || *end || v <= 0) return fail(ps, "invalid pressure_cooldown '%s'", value);
+        current->pressure_cooldown = (int)v;
+    } else if (strcasecmp(key, "max_restarts") == 0) {
+        current->max_restarts = atoi(value);
+    } else if (strcasecmp(key, "backoff_factor") == 0) {
+        if (parse_cpu(value, &current->backoff_factor) != 0 || current->backoff_factor < 1.0)
+            return fail(ps, "invalid backoff_factor (must be >= 1)");
+    } else if (strcasecmp(key, "backoff_max") == 0) {
+        current->backoff_max = atoi(value);
+    } else if (strcasecmp(key, "backoff_jitter") == 0) {
+        if (parse_cpu(value, &current->backoff_jitter) != 0 || current->backoff_jitter >= 1.0)
+            return fail(ps, "invalid backoff_jitter (must be 0 <= x < 1)");
+    } else if (strcasecmp(key, "oom_restart") == 0) {
+        if (parse_restart_policy(value, &current->oom_restart) != 0)
+            return fail(ps, "invalid oom_restart policy");
+    } else if (strcasecmp(key, "oom_restart_delay") == 0) {
+        current->oom_restart_delay = atoi(value);
+    } else if (strcasecmp(key, "oom_backoff_factor") == 0) {
+        if (parse_cpu(value, &current->oom_backoff_factor) != 0 || current->oom_backoff_factor < 1.0)
+            return fail(ps, "invalid oom_backoff_factor (must be >= 1)");
+    } else if (strcasecmp(key, "oom_backoff_max") == 0) {
+        current->oom_backoff_max = atoi(value);
+    } else if (strcasecmp(key, "stdout") == 0) {
+        if (!(current->stdout_path = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "stderr") == 0) {
+        if (!(current->stderr_path = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "stdout_maxbytes") == 0) {
+        if (parse_memory(value, &current->stdout_maxbytes) != 0)
+            return fail(ps, "invalid stdout_maxbytes");
+    } else if (strcasecmp(key, "stdout_backups") == 0) {
+        current->stdout_backups = atoi(value);
+    } else if (strcasecmp(key, "stderr_maxbytes") == 0) {
+        if (parse_memory(value, &current->stderr_maxbytes) != 0)
+            return fail(ps, "invalid stderr_maxbytes");
+    } else if (strcasecmp(key, "stderr_backups") == 0) {
+        current->stderr_backups = atoi(value);
+    } else if (strcasecmp(key, "memory_limit") == 0) {
+        if (parse_memory(value, &current->memory_limit_bytes) != 0)
+            return fail(ps, "invalid memory_limit");
+    } else if (strcasecmp(key, "stop_signal") == 0) {
+        current->stop_signal = parse_signal(value);
+        if (current->stop_signal < 0)
+            return fail(ps, "invalid stop_signal '%s'", value);
+    } else if (strcasecmp(key, "stop_timeout") == 0) {
+        current->stop_timeout = atoi(value);
+        if (current->stop_timeout < 0)
+            return fail(ps, "invalid stop_timeout");
+    } else if (strcasecmp(key, "priority") == 0) {
+        current->priority = atoi(value);
+    } else if (strcasecmp(key, "depends_on") == 0) {
+        if (!(current->depends_on = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "startsecs") == 0) {
+        current->startsecs = atoi(value);
+        if (current->startsecs < 0)
+            return fail(ps, "invalid startsecs");
+    } else if (strcasecmp(key, "healthcheck") == 0) {
+        if (parse_health_type(value, &current->health_type) != 0)
+            return fail(ps, "invalid healthcheck '%s' (exec, tcp, http, file or none)", value);
+    } else if (strcasecmp(key, "healthcheck_command") == 0) {
+        if (!(current->health_command = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "healthcheck_host") == 0) {
+        // localhost is the common case; anything else must be an IPv4 literal
+        struct in_addr addr;
+        if (strcasecmp(value, "localhost") == 0) current->health_host = "127.0.0.1";
+        else if (inet_pton(AF_INET, value, &addr) != 1)
+            return fail(ps, "invalid healthcheck_host '%s' (IPv4 address)", value);
+        else if (!(current->health_host = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "healthcheck_port") == 0) {
+        current->health_port = atoi(value);
+        if (current->health_port <= 0 || current->health_port > 65535)
+            return fail(ps, "invalid healthcheck_port");
+    } else if (strcasecmp(key, "healthcheck_path") == 0) {
+        if (!(current->health_path = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "healthcheck_interval") == 0) {
+        current->health_interval = atoi(value);
+        if (current->health_interval <= 0)
+            return fail(ps, "invalid healthcheck_interval");
+    } else if (strcasecmp(key, "healthcheck_timeout") == 0) {
+        current->health_timeout = atoi(value);
+        if (current->health_timeout <= 0)
+            return fail(ps, "invalid healthcheck_timeout");
+    } else if (strcasecmp(key, "healthcheck_retries") == 0) {
+        current->health_retries = atoi(value);
+        if (current->health_retries <= 0)
+            return fail(ps, "invalid healthcheck_retries");
+    } else if (strcasecmp(key, "healthcheck_maxage") == 0) {
+        current->health_maxage = atoi(value);
+        if (current->health_maxage < 0)
+            return fail(ps, "invalid healthcheck_maxage");
+    } else if (strcasecmp(key, "cpu_limit") == 0) {
+        if (parse_cpu(value, &current->cpu_limit) != 0)
+            return fail(ps, "invalid cpu_limit");
+    } else if (strcasecmp(key, "cpu_period") == 0) {
+        // microseconds, as cpu.max takes it
+        current->cpu_period_us = atoi(value);
+        if (current->cpu_period_us < 1000 || current->cpu_period_us > 1000000)
+            return fail(ps, "invalid cpu_period (1000-1000000 us)");
+    } else if (strcasecmp(key, "memory_high") == 0) {
+        if (parse_memory(value, &current->memory_high_bytes) != 0)
+            return fail(ps, "invalid memory_high");
+    } else if (strcasecmp(key, "memory_swap_max") == 0) {
+        if (parse_memory(value, &current->memory_swap_max_bytes) != 0)
+            return fail(ps, "invalid memory_swap_max");
+    } else if (strcasecmp(key, "cpu_weight") == 0) {
+        current->cpu_weight = atoi(value);
+        if (current->cpu_weight < 1 || current->cpu_weight > 10000)
+            return fail(ps, "invalid cpu_weight (1-10000)");
+    } else if (strcasecmp(key, "pids_max") == 0) {
+        char *end;
+        current->pids_max = strtol(value, &end, 10);
+        if (end == value || *end || current->pids_max < 0)
+            return fail(ps, "invalid pids_max");
+    } else if (strcasecmp(key, "io_max") == 0) {
+        if (parse_io(ps, value, 0, &current->io_max) != 0) return -1;
+    } else if (strcasecmp(key, "io_weight") == 0) {
+        if (parse_io(ps, value, 1, &current->io_weight) != 0) return -1;
+    } else if (strcasecmp(key, "listen") == 0) {
+        if (parse_listen(ps, value, &current->listen) != 0) return -1;
+    } else if (strcasecmp(key, "numprocs") == 0) {
+        current->numprocs = atoi(value);
+        if (current->numprocs < 1 || current->numprocs > MAX_NUMPROCS)
+            return fail(ps, "invalid numprocs (1-%d)", MAX_NUMPROCS);
+    } else if (strcasecmp(key, "cpu_affinity") == 0) {
+        if (parse_cpu_list(value, NULL, 0) < 0)
+            return fail(ps, "invalid cpu_affinity '%s' (e.g. 0-3,6)", value);
+        if (!(current->cpu_affinity = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "numa_node") == 0) {
+        if (parse_cpu_list(value, NULL, 0) < 0)
+            return fail(ps, "invalid numa_node '%s' (e.g. 0 or 0-1)", value);
+        if (!(current->numa_node = intern_value(ps))) return fail(ps, "out of memory");
+    } else if (strcasecmp(key, "pool_memory_limit") == 0) {
+        if (parse_memory(value, &current->pool_memory_limit_bytes) != 0)
+            return fail(ps, "invalid pool_memory_limit");
+    } else if (strcasecmp(key, "pool_cpu_limit") == 0) {
+        if (parse_cpu(value, &current->pool_cpu_limit) != 0)
+            return fail(ps, "invalid pool_cpu_limit");
+    } else {
+        return fail(ps, "unknown key '%s'", key);
+    }
+    return 0;
+}
+
+
+static int parse_file(parser_t *ps, const char *path);
+
+// include=<glob>: relative patterns are taken from the including file's
+// directory; files are read in sorted order, a wildcard may match nothing
+static int parse_include(parser_t *ps, const char *pattern) {
+    if (ps->depth >= MAX_INCLUDE_DEPTH)
+        return fail(ps, "includes nested deeper than %d", MAX_INCLUDE_DEPTH);
+
+    char full[PATH_MAX];
+    const char *slash = strrchr(ps->file, '/');
+    int n;
+    if (pattern[0] == '/' || !slash)
+        n = snprintf(full, sizeof(full), "%s", pattern);
+    else
+        n = snprintf(full, sizeof(full), "%.*s/%s", (int)(slash - ps->file), ps->file, pattern);
+    if (n < 0 || n >= (int)sizeof(full))
+        return fail(ps, "include path too long");
+
+    glob_t g;
+    int rc = glob(full, 0, NULL, &g);
+    if (rc == GLOB_NOMATCH) {
+        globfree(&g);
+        return strpbrk(full, "*?[") ? 0 : fail(ps, "cannot open include '%s'", full);
+    }
+    if (rc != 0) {
+        globfree(&g);
+        return fail(ps, "bad include pattern '%s'", full);
+    }
+
+    // included files start outside any block and leave it that way
+    int in_global = ps->in_global;
+    rc = 0;
+    ps->depth++;
+    for (size_t i = 0; i < g.gl_pathc && rc == 0; i++) {
+        ps->current = NULL;
+        ps->in_global = 0;
+        rc = parse_file(ps, g.gl_pathv[i]);
+    }
+    ps->depth--;
+    ps->current = NULL;
+    ps->in_global = in_global;
+    globfree(&g);
+    return rc;
+}
+
+
+// one line as [s, e), not NUL-terminated (it points into the mapping)
+static int parse_line(parser_t *ps, const char *s, const char *e) {
+    while (s < e && is_space(*s)) s++;
+    while (e > s && is_space(e[-1])) e--;
+
+    // skip blank lines and comments
+    if (s == e || *s == '#')
+        return 0;
+
+    // program block
+    if (e - s >= 8 && memcmp(s, "program", 7) == 0 && is_space(s[7])) {
+        const char *name = s + 8;
+        while (name < e && is_space(*name)) name++;
+        size_t len = (size_t)(e - name);
+        if (len == 0) return fail(ps, "program name missing");
+        if (len >= MAX_NAME_LEN) return fail(ps, "program name longer than %d", MAX_NAME_LEN - 1);
+
+        ps->current = new_program(ps, name, len);
+        if (!ps->current) return fail(ps, "out of memory");
+
+        size_t dup = (size_t)ptrmap_get(&ps->names, ps->current->name);
+        if (dup) {
+            const program_config_t *first = &ps->config->programs[dup - 1];
+            return fail(ps, "duplicate program '%s' (first defined at %s:%u)",
+                        first->name, first->file, first->line);
+        }
+        if (ptrmap_put(&ps->names, ps->current->name, (void *)ps->config->count) != 0)
+            return fail(ps, "out of memory");
+        ps->in_global = 0;
+        return 0;
+    }
+
+    // supervisor-wide settings block
+    if (e - s == 10 && memcmp(s, "supervisor", 10) == 0) {
+        ps->current = NULL;
+        ps->in_global = 1;
+        return 0;
+    }
+
+    // parse key=value
+    const char *eq = memchr(s, '=', (size_t)(e - s));
+    if (!eq) return fail(ps, "invalid line (no =)");
+
+    const char *ke = eq, *v = eq + 1;
+    while (ke > s && is_space(ke[-1])) ke--;
+    while (v < e && is_space(*v)) v++;
 
-            char *name = line + 8;
-            trim(name);
-            if (strlen(name) == 0) {
-                fprintf(stderr, "Line %zu: program name missing\n", line_number);
-                fclose(fp);
-                return -1;
+    char key[MAX_KEY_LEN];
+    size_t klen = (size_t)(ke - s);
+    if (klen >= sizeof(key)) return fail(ps, "unknown key '%.*s'", (int)klen, s);
+    memcpy(key, s, klen);
+    key[klen] = '\0';
+
+    // values have no length limit; the buffer is reused line to line
+    size_t vlen = (size_t)(e - v);
+    if (vlen + 1 > ps->value.cap) {
+        char *d = realloc(ps->value.data, vlen + 1);
+        if (!d) return fail(ps, "out of memory");
+        ps->value.data = d;
+        ps->value.cap = vlen + 1;
+    }
+    memcpy(ps->value.data, v, vlen);
+    ps->value.data[vlen] = '\0';
+    ps->value.len = vlen;
+    const char *value = ps->value.data;
+
+    if (strcasecmp(key, "include") == 0) {
+        if (ps->current) return fail(ps, "include inside a program block");
+        return parse_include(ps, value);
+    }
+
+    if (ps->in_global) {
+        if (parse_global(ps, key, value) != 0)
+            return fail(ps, "invalid supervisor setting '%s'", key);
+        return 0;
+    }
+    if (!ps->current) return fail(ps, "key=value outside program block");
+
+    return parse_program_key(ps, key, value);
+}
+
+
+// map the file and walk it once; no line length limit
+static int parse_file(parser_t *ps, const char *path) {
+    const char *saved_file = ps->file;
+    unsigned saved_line = ps->line;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (saved_file) return fail(ps, "cannot open include '%s': %s", path, strerror(errno));
+        perror("Failed to open config file");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    ps->file = arena_intern(&ps->config->arena, path, strlen(path));
+    ps->line = 0;
+    if (!ps->file) {
+        close(fd);
+        return -1;
+    }
+
+    int rc = 0;
+    if (st.st_size > 0) {
+        const char *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            rc = fail(ps, "mmap failed: %s", strerror(errno));
+        } else {
+            const char *p = data, *end = data + st.st_size;
+            while (p < end && rc == 0) {
+                const char *nl = memchr(p, '\n', (size_t)(end - p));
+                const char *eol = nl ? nl : end;
+                ps->line++;
+                rc = parse_line(ps, p, eol);
+                p = eol + 1;
             }
-            strncpy(current->name, name, MAX_NAME_LEN - 1);
+            munmap((void *)data, (size_t)st.st_size);
+        }
+    }
+    close(fd);
 
-            // defaults
-            current->autostart = true;
-            current->autorestart = RESTART_NEVER;
-            current->restart_delay = 0;
-            current->max_restarts = 0;
+    ps->file = saved_file;
+    ps->line = saved_line;
+    return rc;
+}
 
-            in_program = 1;
-            continue;
+
+// "%(process_num)" becomes the instance number
+static const char *subst_num(arena_t *a, const char *s, int k) {
+    size_t tok = strlen(PROCESS_NUM);
+    if (!strstr(s, PROCESS_NUM)) return s;
+
+    size_t cap = strlen(s) + 1, len = 0;
+    for (const char *c = s; (c = strstr(c, PROCESS_NUM)) != NULL; c += tok)
+        cap += 12;
+    char *buf = malloc(cap);
+    if (!buf) return NULL;
+
+    for (const char *c = s; *c; ) {
+        if (strncmp(c, PROCESS_NUM, tok) == 0) {
+            len += (size_t)sprintf(buf + len, "%d", k);
+            c += tok;
+        } else {
+            buf[len++] = *c++;
         }
+    }
+    const char *out = arena_intern(a, buf, len);
+    free(buf);
+    return out;
+}
 
-  
-        if (!in_program) {
-            fprintf(stderr, "Line %zu: key=value outside program block\n", line_number);
-            fclose(fp);
-            return -1;
+// one numprocs block -> instances "name:0".."name:N-1" in a pool named
+// after the block; a cpu_affinity list is dealt out one cpu per instance
+static int expand_block(arena_t *a, const program_config_t *p, program_config_t *out) {
+    if (p->stdout_path[0] && !strstr(p->stdout_path, PROCESS_NUM))
+        return fail_at(p, "%s", "stdout would be shared by every instance, add " PROCESS_NUM " to it");
+    if (p->stderr_path[0] && !strstr(p->stderr_path, PROCESS_NUM))
+        return fail_at(p, "%s", "stderr would be shared by every instance, add " PROCESS_NUM " to it");
+
+    int ncpus = p->cpu_affinity[0] ? parse_cpu_list(p->cpu_affinity, NULL, 0) : 0;
+    int *cpus = ncpus > 0 ? malloc((size_t)ncpus * sizeof(int)) : NULL;
+    if (ncpus > 0 && !cpus) return fail_at(p, "%s", "out of memory");
+    if (cpus) parse_cpu_list(p->cpu_affinity, cpus, ncpus);
+
+    int rc = 0;
+    for (int k = 0; k < p->numprocs && rc == 0; k++) {
+        program_config_t *q = &out[k];
+        char buf[MAX_NAME_LEN];
+        int len = snprintf(buf, sizeof(buf), "%s:%d", p->name, k);
+        if (len >= MAX_NAME_LEN) {
+            rc = fail_at(p, "%s", "instance names would exceed the name length limit");
+            break;
         }
 
-        // parse key=value
-        char *eq = strchr(line, '=');
-        if (!eq) {
-            fprintf(stderr, "Line %zu: invalid line (no =)\n", line_number);
-            fclose(fp);
+        *q = *p;
+        q->name = arena_intern(a, buf, (size_t)len);
+        q->pool = p->name;
+        q->instance = k;
+        q->command = subst_num(a, p->command, k);
+        q->stdout_path = subst_num(a, p->stdout_path, k);
+        q->stderr_path = subst_num(a, p->stderr_path, k);
+        q->health_command = subst_num(a, p->health_command, k);
+        q->health_path = subst_num(a, p->health_path, k);
+        if (cpus) {
+            len = snprintf(buf, sizeof(buf), "%d", cpus[k % ncpus]);
+            q->cpu_affinity = arena_intern(a, buf, (size_t)len);
+        }
+        if (!q->name || !q->command || !q->stdout_path || !q->stderr_path ||
+            !q->health_command || !q->health_path || !q->cpu_affinity)
+            rc = fail_at(p, "%s", "out of memory");
+    }
+    free(cpus);
+    return rc;
+}
+
+// expand every numprocs block in place; afterwards names maps instance
+// names, and a pool name to its first instance
+static int expand_pools(parser_t *ps) {
+    supervisor_config_t *config = ps->config;
+    size_t total = 0;
+
+    for (size_t i = 0; i < config->count; i++) {
+        program_config_t *p = &config->programs[i];
+        if (p->numprocs == 1 && (p->pool_memory_limit_bytes > 0 || p->pool_cpu_limit > 0))
+            return fail_at(p, "%s", "pool_memory_limit/pool_cpu_limit need numprocs > 1");
+        total += (size_t)p->numprocs;
+    }
+    if (total == config->count) return 0;
+
+    program_config_t *out = malloc(total * sizeof(program_config_t));
+    if (!out) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < config->count; i++) {
+        program_config_t *p = &config->programs[i];
+        if (p->numprocs == 1) {
+            out[n++] = *p;
+            continue;
+        }
+        if (expand_block(&config->arena, p, &out[n]) != 0) {
+            free(out);
             return -1;
         }
-        *eq = '\0';
-        char *key = line;
-        char *value = eq + 1;
-        trim(key);
-        trim(value);
-
-        if (strcasecmp(key, "command") == 0) {
-            strncpy(current->command, value, MAX_COMMAND_LEN - 1);
-        } else if (strcasecmp(key, "autostart") == 0) {
-            if (parse_bool(value, &current->autostart) != 0) {
-                fprintf(stderr, "Line %zu: invalid boolean for autostart\n", line_number);
-                fclose(fp);
-                return -1;
+        n += (size_t)p->numprocs;
+    }
+    free(config->programs);
+    config->programs = out;
+    config->count = config->capacity = total;
+
+    ptrmap_free(&ps->names);
+    for (size_t i = 0; i < total; i++) {
+        program_config_t *p = &out[i];
+        size_t dup = (size_t)ptrmap_get(&ps->names, p->name);
+        if (dup) {
+            char msg[MAX_NAME_LEN + 64];
+            const program_config_t *inst = p->pool[0] ? p : &out[dup - 1];
+            const program_config_t *other = p->pool[0] ? &out[dup - 1] : p;
+            snprintf(msg, sizeof(msg), "%s at %s:%u", inst->pool, inst->file, inst->line);
+            return fail_at(other, "name is also an instance of pool %s", msg);
+        }
+        if (ptrmap_put(&ps->names, p->name, (void *)(i + 1)) != 0)
+            return fail_at(p, "%s", "out of memory");
+    }
+    for (size_t i = 0; i < total; i++) {
+        if (out[i].pool[0] && out[i].instance == 0 &&
+            ptrmap_put(&ps->names, out[i].pool, (void *)(i + 1)) != 0)
+            return fail_at(&out[i], "%s", "out of memory");
+    }
+    return 0;
+}
+
+
+static int is_dep_sep(char c) {
+    return c == ',' || is_space(c);
+}
+
+// next name of a depends_on list as [*w, *s), 0 at the end
+static int next_dep(const char **s, const char **w) {
+    while (**s && is_dep_sep(**s)) (*s)++;
+    *w = *s;
+    while (**s && !is_dep_sep(**s)) (*s)++;
+    return *s > *w;
+}
+
+// turn depends_on names into program indexes, build the reverse edges
+// and levels, and refuse cycles
+static int resolve_dependencies(parser_t *ps) {
+    supervisor_config_t *config = ps->config;
+    arena_t *a = &config->arena;
+    size_t n = config->count;
+
+    for (size_t i = 0; i < n; i++) {
+        program_config_t *p = &config->programs[i];
+        const char *s, *w;
+
+        // a pool name stands for all of its instances
+        size_t words = 0;
+        for (s = p->depends_on; next_dep(&s, &w); ) {
+            const char *name = arena_intern(a, w, (size_t)(s - w));
+            size_t dep = name ? (size_t)ptrmap_get(&ps->names, name) : 0;
+            if (!dep) {
+                char msg[MAX_NAME_LEN + 64];
+                snprintf(msg, sizeof(msg), "%.*s", (int)(s - w), w);
+                return fail_at(p, "depends_on unknown program '%s'", msg);
             }
-        } else if (strcasecmp(key, "autorestart") == 0) {
-            if (parse_restart_policy(value, &current->autorestart) != 0) {
-                fprintf(stderr, "Line %zu: invalid restart policy\n", line_number);
-                fclose(fp);
-                return -1;
+            program_config_t *d = &config->programs[dep - 1];
+            words += d->pool == name ? (size_t)d->numprocs : 1;
+        }
+        if (words == 0) continue;
+
+        p->depends = arena_alloc(a, words * sizeof(size_t));
+        if (!p->depends) return fail_at(p, "%s", "out of memory");
+
+        for (s = p->depends_on; next_dep(&s, &w); ) {
+            const char *name = arena_intern(a, w, (size_t)(s - w));
+            size_t first = (size_t)ptrmap_get(&ps->names, name) - 1;
+            size_t count = config->programs[first].pool == name ? (size_t)config->programs[first].numprocs : 1;
+
+            for (size_t dep = first; dep < first + count; dep++) {
+                int seen = 0;
+                for (size_t k = 0; k < p->ndepends; k++)
+                    seen |= p->depends[k] == dep;
+                if (!seen) {
+                    p->depends[p->ndepends++] = dep;
+                    config->programs[dep].ndependents++;
+                }
             }
-        } else if (strcasecmp(key, "restart_delay") == 0) {
-            current->restart_delay = atoi(value);
-        } else if (strcasecmp(key, "max_restarts") == 0) {
-            current->max_restarts = atoi(value);
-        } else if (strcasecmp(key, "stdout") == 0) {
-            strncpy(current->stdout_path, value, MAX_PATH_LEN - 1);
-        } else if (strcasecmp(key, "stderr") == 0) {
-            strncpy(current->stderr_path, value, MAX_PATH_LEN - 1);
-                    } else if (strcasecmp(key, "memory_limit") == 0) {
-            if (parse_memory(value, &current->memory_limit_bytes) != 0) {
-                fprintf(stderr, "Line %zu: invalid memory_limit\n", line_number);
-                fclose(fp);
-                return -1;
+        }
+    }
+
+    // reverse edges, then Kahn's algorithm for levels; whatever is left
+    // unvisited sits on or behind a cycle
+    size_t *pending = calloc(n ? n : 1, sizeof(size_t));
+    size_t *queue = malloc((n ? n : 1) * sizeof(size_t));
+    if (!pending || !queue) {
+        free(pending);
+        free(queue);
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        program_config_t *p = &config->programs[i];
+        if (p->ndependents) {
+            p->dependents = arena_alloc(a, p->ndependents * sizeof(size_t));
+            if (!p->dependents) {
+                free(pending);
+                free(queue);
+                return fail_at(p, "%s", "out of memory");
             }
+            p->ndependents = 0;
+        }
+    }
+    size_t head = 0, tail = 0;
+    for (size_t i = 0; i < n; i++) {
+        program_config_t *p = &config->programs[i];
+        for (size_t k = 0; k < p->ndepends; k++) {
+            program_config_t *d = &config->programs[p->depends[k]];
+            d->dependents[d->ndependents++] = i;
+        }
+        pending[i] = p->ndepends;
+        if (pending[i] == 0) queue[tail++] = i;
+    }
+    while (head < tail) {
+        program_config_t *p = &config->programs[queue[head++]];
+        for (size_t k = 0; k < p->ndependents; k++) {
+            program_config_t *d = &config->programs[p->dependents[k]];
+            if (d->level < p->level + 1) d->level = p->level + 1;
+            if (--pending[p->dependents[k]] == 0) queue[tail++] = p->dependents[k];
+        }
+    }
 
-        } else if (strcasecmp(key, "cpu_limit") == 0) {
-            if (parse_cpu(value, &current->cpu_limit) != 0) {
-                fprintf(stderr, "Line %zu: invalid cpu_limit\n", line_number);
-                fclose(fp);
-                return -1;
+    int rc = 0;
+    if (tail < n) {
+        // every leftover program has a leftover dependency, so following
+        // them must come back around; mark the walk and print the loop
+        size_t at = 0;
+        while (pending[at] == 0) at++;
+        for (size_t i = 0; i < n; i++) queue[i] = 0;
+        while (!queue[at]) {
+            queue[at] = 1;
+            program_config_t *p = &config->programs[at];
+            for (size_t k = 0; k < p->ndepends; k++) {
+                if (pending[p->depends[k]]) {
+                    at = p->depends[k];
+                    break;
+                }
             }
-        } else {
-            fprintf(stderr, "Line %zu: unknown key '%s'\n", line_number, key);
-            fclose(fp);
-            return -1;
         }
+        program_config_t *p = &config->programs[at];
+        fprintf(stderr, "%s:%u: dependency cycle: %s", p->file, p->line, p->name);
+        size_t start = at;
+        do {
+            p = &config->programs[at];
+            for (size_t k = 0; k < p->ndepends; k++) {
+                if (pending[p->depends[k]]) {
+                    at = p->depends[k];
+                    break;
+                }
+            }
+            fprintf(stderr, " -> %s", config->programs[at].name);
+        } while (at != start);
+        fputc('\n', stderr);
+        rc = -1;
     }
+    free(pending);
+    free(queue);
+    return rc;
+}
+
+
+// load config
+int load_config(const char *filename, supervisor_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    arena_init(&config->arena);
+    config->sample_interval = DEFAULT_SAMPLE_INTERVAL;
+    config->control_socket = DEFAULT_CONTROL_SOCKET;
+    config->metrics_file = "";
+    config->metrics_interval = DEFAULT_METRICS_INTERVAL;
+
+    parser_t ps = { .config = config };
+    int rc = parse_file(&ps, filename);
+    if (rc == 0) rc = expand_pools(&ps);
 
     // sohet l saleme field check
-    for (size_t i = 0; i < config->count; i++) {
-        if (strlen(config->programs[i].command) == 0) {
-            fprintf(stderr, "Program '%s' missing command\n", config->programs[i].name);
-            fclose(fp);
-            return -1;
+    for (size_t i = 0; rc == 0 && i < config->count; i++) {
+        program_config_t *p = &config->programs[i];
+        if (p->command[0] == '\0') {
+            rc = fail_at(p, "%s", "missing command");
+            break;
         }
+        // OOM policy falls back to the regular one
+        if ((int)p->oom_restart < 0) p->oom_restart = p->autorestart;
+        if (p->oom_restart_delay < 0) p->oom_restart_delay = p->restart_delay;
+
+        rc = check_health(p);
+        if (rc == 0 && p->standby_freeze && !p->standby)
+            rc = fail_at(p, "%s", "standby_freeze needs standby=1");
+
+        // direct exec unless the program asked for a shell
+        if (rc == 0 && !p->shell) rc = tokenize_command(&ps, p);
     }
+    if (rc == 0) rc = resolve_dependencies(&ps);
+
+    ptrmap_free(&ps.names);
+    ptrmap_free(&ps.commands);
+    ptrmap_free(&ps.execs);
+    free(ps.value.data);
+    free(ps.words.data);
 
-    fclose(fp);
+    if (rc != 0) {
+        free_config(config);
+        return -1;
+    }
     return 0;
 }
+
+
+static const char *copy_str(arena_t *a, const char *s) {
+    return s ? arena_intern(a, s, strlen(s)) : NULL;
+}
+
+// append a program from another config (a reload keeping a retired
+// program around), re-interning its strings into this config's arena
+long config_adopt_program(supervisor_config_t *config, const program_config_t *src) {
+    if (config->count == config->capacity) {
+        size_t cap = config->capacity ? config->capacity * 2 : 16;
+        program_config_t *grown = realloc(config->programs, cap * sizeof(program_config_t));
+        if (!grown) return -1;
+        config->programs = grown;
+        config->capacity = cap;
+    }
+
+    arena_t *a = &config->arena;
+    program_config_t *p = &config->programs[config->count];
+    *p = *src;
+    p->name = copy_str(a, src->name);
+    p->command = copy_str(a, src->command);
+    p->exec_path = copy_str(a, src->exec_path);
+    p->stdout_path = copy_str(a, src->stdout_path);
+    p->stderr_path = copy_str(a, src->stderr_path);
+    p->file = copy_str(a, src->file);
+    p->health_command = copy_str(a, src->health_command);
+    p->health_host = copy_str(a, src->health_host);
+    p->health_path = copy_str(a, src->health_path);
+    p->pool = copy_str(a, src->pool);
+    p->cpu_affinity = copy_str(a, src->cpu_affinity);
+    p->numa_node = copy_str(a, src->numa_node);
+    p->io_max = copy_str(a, src->io_max);
+    p->io_weight = copy_str(a, src->io_weight);
+    p->listen = copy_str(a, src->listen);
+    p->depends_on = "";       // indexes belong to the other config
+    p->depends = p->dependents = NULL;
+    p->ndepends = p->ndependents = 0;
+    p->level = 0;
+    if (!p->name || !p->command || !p->stdout_path || !p->stderr_path || !p->file ||
+        !p->health_command || !p->health_host || !p->health_path ||
+        !p->pool || !p->cpu_affinity || !p->numa_node || !p->io_max || !p->io_weight ||
+        !p->listen)
+        return -1;
+
+    if (src->argv) {
+        size_t argc = 0;
+        while (src->argv[argc]) argc++;
+        p->argv = arena_alloc(a, (argc + 1) * sizeof(char *));
+        if (!p->argv) return -1;
+        for (size_t i = 0; i < argc; i++) {
+            if (!(p->argv[i] = (char *)copy_str(a, src->argv[i]))) return -1;
+        }
+        p->argv[argc] = NULL;
+    }
+    return (long)config->count++;
+}
+
+
+void free_config(supervisor_config_t *config) {
+    free(config->programs);
+    arena_free(&config->arena);
+    config->programs = NULL;
+    config->count = 0;
+    config->capacity = 0;
+}
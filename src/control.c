@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include "control.h"
+#include "event.h"
+#include "logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MAX_REQUEST 4096
+#define MAX_ARGS 16
+#define MAX_PENDING (4 * 1024 * 1024)   // unread replies before a pipelining client is dropped
+
+// wire format: the client sends one command per line; every command gets
+// a header line "OK <n>" or "ERR <message>" followed by n data lines
+
+typedef struct conn {
+    int fd;
+    char in[MAX_REQUEST];
+    size_t in_len;
+    ctl_reply_t out;     // bytes not yet written
+    size_t out_off;
+    int eof;             // client half-closed; only the reply is left to send
+    struct conn *prev, *next;
+} conn_t;
+
+static int listen_fd = -1;
+static conn_t *conns = NULL;   // open connections, closed with the listener
+static char *socket_path = NULL;
+static ctl_handler_t dispatch = NULL;
+
+
+static void reply_append(ctl_reply_t *r, const char *fmt, va_list ap) {
+    for (;;) {
+        size_t room = r->cap - r->len;
+        va_list copy;
+        va_copy(copy, ap);
+        int n = room ? vsnprintf(r->data + r->len, room, fmt, copy) : -1;
+        va_end(copy);
+
+        if (n >= 0 && (size_t)n < room) {
+            r->len += (size_t)n;
+            return;
+        }
+        size_t cap = r->cap ? r->cap * 2 : 4096;
+        while (n >= 0 && cap - r->len <= (size_t)n) cap *= 2;
+        char *d = realloc(r->data, cap);
+        if (!d) return;
+        r->data = d;
+        r->cap = cap;
+    }
+}
+
+
+void ctl_printf(ctl_reply_t *r, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    reply_append(r, fmt, ap);
+    va_end(ap);
+    r->lines++;
+}
+
+
+void ctl_error(ctl_reply_t *r, const char *fmt, ...) {
+    va_list ap;
+    r->len = r->lines = 0;    // an error replaces any partial output
+    r->failed = 1;
+    va_start(ap, fmt);
+    reply_append(r, fmt, ap);
+    va_end(ap);
+}
+
+
+static void conn_close(conn_t *c) {
+    if (c->prev) c->prev->next = c->next;
+    else conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    event_del(c->fd);
+    close(c->fd);
+    free(c->out.data);
+    free(c);
+}
+
+
+// push out as much as the socket takes; wait for EPOLLOUT for the rest.
+// after EOF, EPOLLIN stays ready forever, so only EPOLLOUT is watched
+// and the connection is done (-1) once the reply is out
+static int conn_flush(conn_t *c) {
+    while (c->out_off < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->out_off, c->out.len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) {
+                event_mod(c->fd, c->eof ? EPOLLOUT : EPOLLIN | EPOLLOUT);
+                return 0;
+            }
+            return -1;
+        }
+        c->out_off += (size_t)n;
+    }
+    c->out.len = c->out_off = 0;
+    if (c->eof) return -1;
+    event_mod(c->fd, EPOLLIN);
+    return 0;
+}
+
+
+static void run_command(conn_t *c, char *line) {
+    char *argv[MAX_ARGS];
+    int argc = 0;
+    for (char *tok = strtok(line, " \t\r"); tok && argc < MAX_ARGS; tok = strtok(NULL, " \t\r"))
+        argv[argc++] = tok;
+    if (argc == 0) return;
+
+    ctl_reply_t body = {0};
+    dispatch(argc, argv, &body);
+
+    // header first, then the body as built
+    ctl_reply_t *out = &c->out;
+    if (body.failed) {
+        ctl_printf(out, "ERR %.*s\n", (int)body.len, body.data ? body.data : "");
+    } else {
+        ctl_printf(out, "OK %zu\n", body.lines);
+        if (body.len) ctl_printf(out, "%.*s", (int)body.len, body.data);
+    }
+    free(body.data);
+}
+
+
+static void on_conn(int fd, uint32_t events, void *ctx) {
+    (void)fd;
+    conn_t *c = ctx;
+
+    if ((events & EPOLLIN) && !c->eof) {
+        for (;;) {
+            ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+            if (n == 0) {                       // client done
+                c->eof = 1;
+                break;
+            }
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN) break;
+                conn_close(c);
+                return;
+            }
+            c->in_len += (size_t)n;
+
+            // every complete line is one command (pipelining is fine)
+            char *start = c->in, *nl;
+            while ((nl = memchr(start, '\n', c->in_len - (size_t)(start - c->in)))) {
+                if (c->out.len - c->out_off > MAX_PENDING) {   // not reading its replies
+                    conn_close(c);
+                    return;
+                }
+                *nl = '\0';
+                run_command(c, start);
+                start = nl + 1;
+            }
+            c->in_len -= (size_t)(start - c->in);
+            memmove(c->in, start, c->in_len);
+
+            if (c->in_len == sizeof(c->in)) {   // line too long
+                conn_close(c);
+                return;
+            }
+        }
+    }
+
+    if (conn_flush(c) != 0 || (events & (EPOLLHUP | EPOLLERR)))
+        conn_close(c);
+}
+
+
+static void on_accept(int fd, uint32_t events, void *ctx) {
+    (void)events;
+    (void)ctx;
+
+    for (;;) {
+        int cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd < 0) return;   // EAGAIN or transient error
+
+        conn_t *c = calloc(1, sizeof(*c));
+        if (!c || event_add(cfd, EPOLLIN, on_conn, c) != 0) {
+            free(c);
+            close(cfd);
+            continue;
+        }
+        c->fd = cfd;
+        c->next = conns;
+        if (conns) conns->prev = c;
+        conns = c;
+    }
+}
+
+
+int control_open(const char *path, ctl_handler_t handler) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Control socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("control socket failed");
+        return -1;
+    }
+
+    unlink(path);   // stale socket from a previous run
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, 64) != 0 ||
+        event_add(listen_fd, EPOLLIN, on_accept, NULL) != 0) {
+        perror("control socket bind failed");
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+
+    socket_path = strdup(path);
+    dispatch = handler;
+    log_message("Control socket listening on %s\n", path);
+    return 0;
+}
+
+
+void control_close(void) {
+    while (conns) conn_close(conns);
+    if (listen_fd < 0) return;
+
+    event_del(listen_fd);
+    close(listen_fd);
+    listen_fd = -1;
+    if (socket_path) unlink(socket_path);
+    free(socket_path);
+    socket_path = NULL;
+}
+
+
+// blocking client used by "Msupervisor ctl ..."
+int control_client(const char *path, int argc, char **argv) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) return 1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Cannot connect to %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+
+    char req[MAX_REQUEST];
+    size_t len = 0;
+    for (int i = 0; i < argc; i++) {
+        int n = snprintf(req + len, sizeof(req) - len, "%s%s", i ? " " : "", argv[i]);
+        if (n < 0 || (size_t)n >= sizeof(req) - len - 1) {
+            fprintf(stderr, "Command too long\n");
+            close(fd);
+            return 1;
+        }
+        len += (size_t)n;
+    }
+    req[len++] = '\n';
+
+    if (send(fd, req, len, MSG_NOSIGNAL) != (ssize_t)len) {
+        perror("send failed");
+        close(fd);
+        return 1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    FILE *in = fdopen(fd, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    int rc = 1;
+
+    if (in && getline(&line, &cap, in) > 0) {
+        if (strncmp(line, "OK ", 3) == 0) {
+            rc = 0;
+            while (getline(&line, &cap, in) > 0)
+                fputs(line, stdout);
+        } else {
+            fputs(line, stderr);
+        }
+    }
+    free(line);
+    if (in) fclose(in);
+    else close(fd);
+    return rc;
+}
@@ -0,0 +1,121 @@
+#include "event.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define MAX_EVENTS 64
+
+typedef struct {
+    event_handler_t fn;
+    void *ctx;
+} handler_t;
+
+static int epoll_fd = -1;
+static handler_t *handlers = NULL;   // indexed by fd
+static size_t handlers_cap = 0;
+static uint64_t woke_us = 0;
+
+
+uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+
+static int ensure_capacity(int fd) {
+    if ((size_t)fd < handlers_cap) return 0;
+
+    size_t cap = handlers_cap ? handlers_cap : 64;
+    while (cap <= (size_t)fd) cap *= 2;
+
+    handler_t *h = realloc(handlers, cap * sizeof(handler_t));
+    if (!h) return -1;
+    memset(h + handlers_cap, 0, (cap - handlers_cap) * sizeof(handler_t));
+
+    handlers = h;
+    handlers_cap = cap;
+    return 0;
+}
+
+
+int event_init(void) {
+    if (epoll_fd >= 0) return 0;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    return 0;
+}
+
+
+int event_add(int fd, uint32_t events, event_handler_t handler, void *ctx) {
+    if (fd < 0 || ensure_capacity(fd) != 0) return -1;
+
+    struct epoll_event ev = { .events = events, .data.fd = fd };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        perror("epoll_ctl add failed");
+        return -1;
+    }
+
+    handlers[fd].fn = handler;
+    handlers[fd].ctx = ctx;
+    return 0;
+}
+
+
+int event_mod(int fd, uint32_t events) {
+    struct epoll_event ev = { .events = events, .data.fd = fd };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+
+// must be called before the fd is closed
+void event_del(int fd) {
+    if (fd < 0 || (size_t)fd >= handlers_cap) return;
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    handlers[fd].fn = NULL;
+    handlers[fd].ctx = NULL;
+}
+
+
+// block until at least one fd is ready (or timeout), then dispatch
+int event_wait(int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    woke_us = now_us();
+    if (n < 0) {
+        if (errno == EINTR) return 0;
+        perror("epoll_wait failed");
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        // an earlier handler in this batch may have removed it
+        if ((size_t)fd >= handlers_cap || !handlers[fd].fn) continue;
+        handlers[fd].fn(fd, events[i].events, handlers[fd].ctx);
+    }
+    return n;
+}
+
+uint64_t event_woke_us(void) {
+    return woke_us;
+}
+
+
+void event_close(void) {
+    if (epoll_fd >= 0) close(epoll_fd);
+    epoll_fd = -1;
+
+    free(handlers);
+    handlers = NULL;
+    handlers_cap = 0;
+}
@@ -0,0 +1,317 @@
+#define _GNU_SOURCE
+#include "health.h"
+#include "event.h"
+#include "timer.h"
+#include "spawn.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+enum { PROBE_IDLE, PROBE_CONNECTING, PROBE_SENDING, PROBE_READING, PROBE_EXEC, PROBE_REAPING };
+
+static int devnull = -1;    // probe output goes nowhere
+
+static void on_probe_event(int fd, uint32_t events, void *ctx);
+
+
+const char *health_type_str(health_type_t t) {
+    switch (t) {
+        case HEALTH_EXEC: return "exec";
+        case HEALTH_TCP: return "tcp";
+        case HEALTH_HTTP: return "http";
+        case HEALTH_FILE: return "file";
+        default: return "none";
+    }
+}
+
+health_probe_t *health_new(health_done_t done, void *ctx) {
+    health_probe_t *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    h->fd = -1;
+    h->timer = -1;
+    h->done = done;
+    h->ctx = ctx;
+    return h;
+}
+
+int health_busy(const health_probe_t *h) {
+    return h->phase != PROBE_IDLE;
+}
+
+static void close_fd(health_probe_t *h) {
+    if (h->fd >= 0) {
+        event_del(h->fd);
+        close(h->fd);
+    }
+    h->fd = -1;
+}
+
+// tear the probe down; a live exec probe is killed and reaped when its
+// pidfd fires, never waited for here
+static void drop(health_probe_t *h) {
+    timer_cancel(h->timer);
+    h->timer = -1;
+
+    if (h->phase == PROBE_EXEC) {
+        kill(-h->pid, SIGKILL);
+        h->phase = PROBE_REAPING;
+        return;
+    }
+    if (h->phase != PROBE_REAPING) {
+        close_fd(h);
+        h->phase = PROBE_IDLE;
+    }
+}
+
+static void finish(health_probe_t *h, int ok, const char *detail) {
+    drop(h);
+    snprintf(h->detail, sizeof(h->detail), "%s", detail);
+    h->done(h->ctx, ok, h->detail);
+}
+
+static void on_probe_timeout(void *ctx) {
+    health_probe_t *h = ctx;
+    h->timer = -1;
+    finish(h, 0, "timed out");
+}
+
+
+// exec: /bin/sh -c command, healthy on exit 0
+static void start_exec(health_probe_t *h, const program_config_t *p, const sigset_t *mask) {
+    if (devnull < 0) devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    char *const argv[] = { (char *)"sh", (char *)"-c", (char *)p->health_command, NULL };
+    spawn_req_t req = {
+        .path = "/bin/sh",
+        .argv = argv,
+        .envp = NULL,
+        .stdout_fd = devnull,
+        .stderr_fd = devnull,
+        .cgroup_fd = -1,
+        .sigmask = mask,
+        .engine = SPAWN_AUTO,
+    };
+
+    int pidfd;
+    pid_t pid = spawn_process(&req, &pidfd);
+    if (pid < 0) {
+        finish(h, 0, strerror(errno));
+        return;
+    }
+    if (pidfd < 0) pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd < 0 || event_add(pidfd, EPOLLIN, on_probe_event, h) != 0) {
+        // without a pidfd the exit could only be seen through SIGCHLD
+        kill(-pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        if (pidfd >= 0) close(pidfd);
+        finish(h, 0, "no pidfd for exec probe");
+        return;
+    }
+    h->pid = pid;
+    h->fd = pidfd;
+    h->phase = PROBE_EXEC;
+}
+
+static void exec_exited(health_probe_t *h) {
+    int status;
+    if (waitpid(h->pid, &status, WNOHANG) != h->pid) return;
+
+    int was = h->phase;
+    h->pid = 0;
+    close_fd(h);
+    h->phase = PROBE_IDLE;
+
+    if (was == PROBE_REAPING) {   // result already reported as a timeout
+        if (h->orphan) free(h);
+        return;
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        finish(h, 1, "");
+        return;
+    }
+    char msg[32];
+    if (WIFEXITED(status)) snprintf(msg, sizeof(msg), "exit %d", WEXITSTATUS(status));
+    else snprintf(msg, sizeof(msg), "signal %d", WTERMSIG(status));
+    finish(h, 0, msg);
+}
+
+
+// tcp/http: non-blocking connect, completion arrives as EPOLLOUT
+static void start_connect(health_probe_t *h, const program_config_t *p) {
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)p->health_port);
+    inet_pton(AF_INET, p->health_host, &sa.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        finish(h, 0, strerror(errno));
+        return;
+    }
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 && errno != EINPROGRESS) {
+        int err = errno;
+        close(fd);
+        finish(h, 0, strerror(err));
+        return;
+    }
+    if (event_add(fd, EPOLLOUT, on_probe_event, h) != 0) {
+        close(fd);
+        finish(h, 0, "event_add failed");
+        return;
+    }
+    h->fd = fd;
+    h->phase = PROBE_CONNECTING;
+
+    h->len = h->off = 0;
+    if (p->health_type == HEALTH_HTTP) {
+        int n = snprintf(h->buf, sizeof(h->buf),
+                         "GET %s HTTP/1.0\r\nHost: %s:%d\r\nConnection: close\r\n\r\n",
+                         p->health_path, p->health_host, p->health_port);
+        h->len = n > 0 && (size_t)n < sizeof(h->buf) ? (size_t)n : 0;
+    }
+}
+
+static void on_connected(health_probe_t *h) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(h->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) err = errno;
+    if (err) {
+        finish(h, 0, strerror(err));
+        return;
+    }
+    if (h->len == 0) {   // plain tcp: accepting connections is enough
+        finish(h, 1, "");
+        return;
+    }
+    h->phase = PROBE_SENDING;
+}
+
+static void send_request(health_probe_t *h) {
+    ssize_t n = send(h->fd, h->buf + h->off, h->len - h->off, MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno != EAGAIN) finish(h, 0, strerror(errno));
+        return;
+    }
+    h->off += (size_t)n;
+    if (h->off < h->len) return;
+
+    h->phase = PROBE_READING;
+    h->len = 0;
+    event_mod(h->fd, EPOLLIN);
+}
+
+// only the status line matters: "HTTP/1.x 200 ..."
+static void read_status(health_probe_t *h) {
+    ssize_t n = recv(h->fd, h->buf + h->len, sizeof(h->buf) - 1 - h->len, 0);
+    if (n < 0) {
+        if (errno != EAGAIN) finish(h, 0, strerror(errno));
+        return;
+    }
+    h->len += (size_t)n;
+    h->buf[h->len] = '\0';
+    if (n > 0 && !strchr(h->buf, '\n') && h->len < sizeof(h->buf) - 1)
+        return;
+
+    int code = 0;
+    if (sscanf(h->buf, "HTTP/%*d.%*d %d", &code) != 1) {
+        finish(h, 0, "bad http response");
+        return;
+    }
+    char msg[32];
+    snprintf(msg, sizeof(msg), "http %d", code);
+    finish(h, code >= 200 && code < 400, code >= 200 && code < 400 ? "" : msg);
+}
+
+static void on_probe_event(int fd, uint32_t events, void *ctx) {
+    (void)fd;
+    health_probe_t *h = ctx;
+
+    switch (h->phase) {
+    case PROBE_EXEC:
+    case PROBE_REAPING:
+        exec_exited(h);
+        break;
+    case PROBE_CONNECTING:
+        on_connected(h);
+        if (h->phase == PROBE_SENDING) send_request(h);
+        break;
+    case PROBE_SENDING:
+        send_request(h);
+        break;
+    case PROBE_READING:
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) read_status(h);
+        break;
+    }
+}
+
+
+// file: a stat is cheap enough to answer inline
+static void check_file(health_probe_t *h, const program_config_t *p) {
+    struct stat st;
+    if (stat(p->health_path, &st) != 0) {
+        finish(h, 0, strerror(errno));
+        return;
+    }
+    if (p->health_maxage > 0) {
+        long age = (long)(time(NULL) - st.st_mtime);
+        if (age > p->health_maxage) {
+            char msg[48];
+            snprintf(msg, sizeof(msg), "stale, modified %lds ago", age);
+            finish(h, 0, msg);
+            return;
+        }
+    }
+    finish(h, 1, "");
+}
+
+
+int health_start(health_probe_t *h, const program_config_t *p, const sigset_t *mask) {
+    if (health_busy(h)) return -1;
+
+    h->timer = timer_add(p->health_timeout * 1000ull, on_probe_timeout, h);
+    switch (p->health_type) {
+    case HEALTH_EXEC:
+        start_exec(h, p, mask);
+        break;
+    case HEALTH_TCP:
+    case HEALTH_HTTP:
+        start_connect(h, p);
+        break;
+    case HEALTH_FILE:
+        check_file(h, p);
+        break;
+    case HEALTH_NONE:
+        finish(h, 1, "");
+        break;
+    }
+    return 0;
+}
+
+void health_cancel(health_probe_t *h) {
+    if (h) drop(h);
+}
+
+void health_free(health_probe_t *h) {
+    if (!h) return;
+    drop(h);
+    if (h->phase == PROBE_REAPING) {
+        h->orphan = 1;   // freed once its child is reaped
+        return;
+    }
+    free(h);
+}
@@ -0,0 +1,167 @@
+#include "listen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+typedef struct {
+    char *spec;
+    int fd;
+    int refs;
+} listener_t;
+
+static listener_t *listeners = NULL;   // a handful at most, searched linearly
+static size_t listener_count = 0;
+
+
+static int bind_tcp(const char *addr_port) {
+    char host[64];
+    const char *colon = strrchr(addr_port, ':');
+    if (!colon || (size_t)(colon - addr_port) >= sizeof(host)) {
+        errno = EINVAL;
+        return -1;
+    }
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - addr_port), addr_port);
+
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)atoi(colon + 1));
+    if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+static int bind_unix(const char *path) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sa.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(sa.sun_path, path);
+
+    // a socket left behind by an earlier run; anything else stays
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+
+static listener_t *find(const char *spec, size_t len) {
+    for (size_t i = 0; i < listener_count; i++) {
+        if (strlen(listeners[i].spec) == len && strncmp(listeners[i].spec, spec, len) == 0)
+            return &listeners[i];
+    }
+    return NULL;
+}
+
+// one reference on spec[0..len), binding it on first use
+static int acquire(const char *spec, size_t len) {
+    listener_t *l = find(spec, len);
+    if (l) {
+        l->refs++;
+        return l->fd;
+    }
+
+    char *copy = strndup(spec, len);
+    listener_t *grown = copy ? realloc(listeners, (listener_count + 1) * sizeof(listener_t)) : NULL;
+    if (!grown) {
+        free(copy);
+        errno = ENOMEM;
+        return -1;
+    }
+    listeners = grown;
+
+    int fd = strncmp(copy, "unix:", 5) == 0 ? bind_unix(copy + 5) : bind_tcp(copy + 4);
+    if (fd < 0) {
+        free(copy);
+        return -1;
+    }
+    listeners[listener_count++] = (listener_t){ .spec = copy, .fd = fd, .refs = 1 };
+    return fd;
+}
+
+static void release(const char *spec, size_t len) {
+    listener_t *l = find(spec, len);
+    if (!l || --l->refs > 0) return;
+
+    close(l->fd);
+    if (strncmp(l->spec, "unix:", 5) == 0) unlink(l->spec + 5);
+    free(l->spec);
+    *l = listeners[--listener_count];
+    if (listener_count == 0) {
+        free(listeners);
+        listeners = NULL;
+    }
+}
+
+
+// release the first n entries of a spec list (all of them when n < 0)
+static void listen_close_n(const char *specs, int n) {
+    const char *s = specs;
+    while (*s && n-- != 0) {
+        const char *end = strchr(s, '\n');
+        if (!end) end = s + strlen(s);
+        release(s, (size_t)(end - s));
+        s = *end ? end + 1 : end;
+    }
+}
+
+
+int listen_open(const char *specs, int *fds, int max, char *err, size_t errlen) {
+    int n = 0;
+    const char *s = specs;
+
+    while (*s) {
+        const char *end = strchr(s, '\n');
+        if (!end) end = s + strlen(s);
+        if (n == max) {
+            snprintf(err, errlen, "more than %d listen sockets", max);
+            listen_close_n(specs, n);
+            return -1;
+        }
+        int fd = acquire(s, (size_t)(end - s));
+        if (fd < 0) {
+            snprintf(err, errlen, "%.*s: %s", (int)(end - s), s, strerror(errno));
+            listen_close_n(specs, n);
+            return -1;
+        }
+        fds[n++] = fd;
+        s = *end ? end + 1 : end;
+    }
+    return n;
+}
+
+void listen_close(const char *specs) {
+    listen_close_n(specs, -1);
+}
@@ -1,51 +1,161 @@
 #include "logging.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
+#include <signal.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+
+#define LOG_PATH "supervisor.log"
+#define LINE_MAX_LEN 2048
+
+// producers append formatted lines to a preallocated ring; the event
+// loop drains it with one writev per batch
+static char ring[LOG_RING_SIZE];
+static size_t ring_head = 0;    // next write position
+static size_t ring_len = 0;     // bytes pending
+static unsigned long dropped = 0;   // lines that found the ring full, reported once it drains
+
+static int log_fd = -1;
+static long log_size = 0;
+
+static time_t cached_sec = -1;
+static char cached_ts[32];
+
+
+const char *log_timestamp(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);   // vDSO, no syscall
+
+    if (now.tv_sec != cached_sec) {
+        struct tm tm;
+        localtime_r(&now.tv_sec, &tm);
+        strftime(cached_ts, sizeof(cached_ts), "%Y-%m-%d %H:%M:%S", &tm);
+        cached_sec = now.tv_sec;
+    }
+    return cached_ts;
+}
 
-FILE *supervisor_log = NULL;
 
 // open the supervisor log, rotate if big
 void open_supervisor_log(void) {
-    if (supervisor_log) {
-        fclose(supervisor_log);
-        supervisor_log = NULL;
-    }
+    if (log_fd >= 0 && log_fd != STDOUT_FILENO) close(log_fd);
+    log_fd = -1;
 
     struct stat st;
-    if (stat("supervisor.log", &st) == 0 && st.st_size >= MAX_LOG_SIZE) {
+    if (stat(LOG_PATH, &st) == 0 && st.st_size >= MAX_LOG_SIZE) {
         char backup[256];
         time_t now = time(NULL);
         strftime(backup, sizeof(backup), "supervisor-%Y%m%d-%H%M%S.log", localtime(&now));
-        if (rename("supervisor.log", backup) != 0) {
+        if (rename(LOG_PATH, backup) != 0) {
             perror("Failed to rotate supervisor.log");
         }
     }
 
-    supervisor_log = fopen("supervisor.log", "a");
-    if (!supervisor_log) {
+    log_fd = open(LOG_PATH, O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
         perror("Failed to open supervisor.log");
-        supervisor_log = stdout; // fallback to stdout
+        log_fd = STDOUT_FILENO; // fallback to stdout
+        log_size = 0;
+        return;
     }
+    log_size = fstat(log_fd, &st) == 0 ? (long)st.st_size : 0;
 }
 
 
-void log_message(const char *fmt, ...) {
-    if (!supervisor_log) open_supervisor_log();
+static void ring_append(const char *data, size_t len);
+
+// async-signal-safe: only writev of the preallocated ring to the fd
+// already open, so the crash handler can use it as is
+static void write_ring(void) {
+    while (ring_len > 0 && log_fd >= 0) {
+        size_t tail = (ring_head + LOG_RING_SIZE - ring_len) % LOG_RING_SIZE;
+        size_t first = ring_len < LOG_RING_SIZE - tail ? ring_len : LOG_RING_SIZE - tail;
 
-    char ts[64];
-    time_t now = time(NULL);
-    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime(&now));
+        struct iovec iov[2] = {
+            { .iov_base = ring + tail, .iov_len = first },
+            { .iov_base = ring, .iov_len = ring_len - first },
+        };
+        ssize_t n = writev(log_fd, iov, iov[1].iov_len ? 2 : 1);
+        if (n <= 0) break;   // drop nothing, retry on the next flush
 
-    fprintf(supervisor_log, "[%s] ", ts);
+        ring_len -= (size_t)n;
+        log_size += n;
+    }
+}
+
+void log_flush(void) {
+    write_ring();
+    if (dropped > 0 && ring_len == 0) {
+        char line[96];
+        int n = snprintf(line, sizeof(line), "[%s] %lu log lines dropped, the log fell behind\n",
+                         log_timestamp(), dropped);
+        dropped = 0;
+        ring_append(line, (size_t)n);
+        write_ring();
+    }
+
+    // size-based rotation, checked once per batch
+    if (log_size >= MAX_LOG_SIZE && log_fd != STDOUT_FILENO)
+        open_supervisor_log();
+}
+
+
+static void ring_append(const char *data, size_t len) {
+    if (len > LOG_RING_SIZE - ring_len) log_flush();   // backpressure
+    if (len > LOG_RING_SIZE - ring_len) {              // the log fd is failing
+        dropped++;
+        return;
+    }
+
+    size_t first = len < LOG_RING_SIZE - ring_head ? len : LOG_RING_SIZE - ring_head;
+    memcpy(ring + ring_head, data, first);
+    memcpy(ring, data + first, len - first);
+    ring_head = (ring_head + len) % LOG_RING_SIZE;
+    ring_len += len;
+}
+
+
+void log_message(const char *fmt, ...) {
+    if (log_fd < 0) open_supervisor_log();
+
+    char line[LINE_MAX_LEN];
+    int n = snprintf(line, sizeof(line), "[%s] ", log_timestamp());
 
     va_list args;
     va_start(args, fmt);
-    vfprintf(supervisor_log, fmt, args);
+    int m = vsnprintf(line + n, sizeof(line) - n - 1, fmt, args);
     va_end(args);
 
-    fprintf(supervisor_log, "\n");
-    fflush(supervisor_log); // written immediately
+    if (m < 0) m = 0;
+    if ((size_t)(n + m) > sizeof(line) - 2) m = (int)sizeof(line) - 2 - n;   // truncated
+    n += m;
+    line[n++] = '\n';
+
+    ring_append(line, (size_t)n);
+}
+
+
+static void crash_handler(int sig) {
+    write_ring();   // no reopen or rotation here
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+
+void log_install_crash_flush(void) {
+    static const int fatal[] = { SIGSEGV, SIGBUS, SIGABRT, SIGFPE, SIGILL };
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = crash_handler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+
+    for (size_t i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++)
+        sigaction(fatal[i], &sa, NULL);
+    atexit(log_flush);
 }
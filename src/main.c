@@ -1,6 +1,10 @@
 #include "config.h"
 #include "supervisor.h"
+#include "control.h"
+#include "health.h"
+#include "pressure.h"
 #include <stdio.h>
+#include <string.h>
 
 const char *restart_policy_str(restart_policy_t p) {
     switch (p) {
@@ -11,8 +15,27 @@ const char *restart_policy_str(restart_policy_t p) {
     }
 }
 
+// Msupervisor ctl [-s socket] <command> [args...]
+static int run_client(int argc, char *argv[]) {
+    const char *sock = DEFAULT_CONTROL_SOCKET;
+    int i = 2;
+
+    if (i + 1 < argc && strcmp(argv[i], "-s") == 0) {
+        sock = argv[i + 1];
+        i += 2;
+    }
+    if (i >= argc) {
+        fprintf(stderr, "Usage: Msupervisor ctl [-s socket] status [--all|name...] | start|stop|restart|freeze|thaw <name> | signal <name> <sig> | history <name...> | latency | metrics\n");
+        return 2;
+    }
+    return control_client(sock, argc - i, argv + i);
+}
+
 int main(int argc, char *argv[]) {
     const char *config_file = "supervisor.conf";
+    if (argc > 1 && strcmp(argv[1], "ctl") == 0) {
+        return run_client(argc, argv);
+    }
     if (argc > 1) {
         config_file = argv[1];
     }
@@ -24,24 +47,75 @@ int main(int argc, char *argv[]) {
     }
 
     printf("Loaded %zu programs from %s\n\n", config.count, config_file);
+    if (config.freeze_memory_pressure > 0 || config.freeze_cpu_pressure > 0)
+        printf("Pressure freeze: memory %g%%, cpu %g%% (some avg10, 0 = off)\n\n",
+               config.freeze_memory_pressure, config.freeze_cpu_pressure);
 
     for (size_t i = 0; i < config.count; i++) {
         program_config_t *p = &config.programs[i];
         printf("Program: %s\n", p->name);
         printf("  command: %s\n", p->command);
+        printf("  exec: %s\n", p->shell ? "/bin/sh -c (shell=true)" : p->exec_path);
         printf("  autostart: %s\n", p->autostart ? "true" : "false");
         printf("  autorestart: %s\n", restart_policy_str(p->autorestart));
         printf("  restart_delay: %d\n", p->restart_delay);
+        if (p->restart_mode == RESTART_MODE_ROLLING || p->standby)
+            printf("  restart_mode: %s, standby=%d%s\n",
+                   p->restart_mode == RESTART_MODE_ROLLING ? "rolling" : "stop-start",
+                   p->standby, p->standby_freeze ? " (frozen)" : "");
         printf("  max_restarts: %d\n", p->max_restarts);
+        printf("  backoff: factor=%.2f max=%d jitter=%.2f\n",
+               p->backoff_factor, p->backoff_max, p->backoff_jitter);
+        printf("  oom_restart: %s (delay=%d factor=%.2f max=%d)\n", restart_policy_str(p->oom_restart),
+               p->oom_restart_delay, p->oom_backoff_factor, p->oom_backoff_max);
         printf("  memory_limit: %ld\n", p->memory_limit_bytes);
         printf("  cpu_limit: %f\n", p->cpu_limit);
+        printf("  cpu: period=%dus weight=%d, memory_high=%ld swap_max=%ld, pids_max=%ld\n",
+               p->cpu_period_us, p->cpu_weight, p->memory_high_bytes, p->memory_swap_max_bytes, p->pids_max);
+        if (p->io_max[0] || p->io_weight[0])
+            printf("  io: max=[%s] weight=[%s]\n", p->io_max, p->io_weight);
+        if (p->pool[0])
+            printf("  pool: %s, instance %d of %d (pool memory_limit=%ld cpu_limit=%f)\n",
+                   p->pool, p->instance, p->numprocs, p->pool_memory_limit_bytes, p->pool_cpu_limit);
+        if (p->cpu_affinity[0] || p->numa_node[0])
+            printf("  cpuset: cpus=%s mems=%s\n", p->cpu_affinity[0] ? p->cpu_affinity : "(inherit)",
+                   p->numa_node[0] ? p->numa_node : "(inherit)");
+        for (const char *l = p->listen; *l; ) {
+            const char *e = strchr(l, '\n');
+            printf("  listen: %.*s\n", (int)(e ? e - l : (long)strlen(l)), l);
+            l = e ? e + 1 : l + strlen(l);
+        }
         printf("  stdout: %s\n", p->stdout_path[0] ? p->stdout_path : "(none)");
         printf("  stderr: %s\n", p->stderr_path[0] ? p->stderr_path : "(none)");
+        printf("  stop: %s, %ds timeout, priority %d%s\n",
+               signal_str(p->stop_signal), p->stop_timeout, p->priority,
+               p->freeze_on_pressure ? ", frozen under host pressure" : "");
+        printf("  depends_on: %s (startsecs=%d)\n",
+               p->depends_on[0] ? p->depends_on : "(none)", p->startsecs);
+        if (p->health_type == HEALTH_EXEC)
+            printf("  healthcheck: exec '%s'", p->health_command);
+        else if (p->health_type == HEALTH_FILE)
+            printf("  healthcheck: file %s (maxage=%d)", p->health_path, p->health_maxage);
+        else if (p->health_type != HEALTH_NONE)
+            printf("  healthcheck: %s %s:%d%s", health_type_str(p->health_type), p->health_host,
+                   p->health_port, p->health_type == HEALTH_HTTP ? p->health_path : "");
+        if (p->health_type != HEALTH_NONE)
+            printf(" every %ds, timeout %ds, %d retries\n",
+                   p->health_interval, p->health_timeout, p->health_retries);
+        for (int k = 0; k < p->pressure_count; k++) {
+            const pressure_trigger_t *t = &p->pressure[k];
+            printf("  pressure_trigger: %s %s %dms in %dms, %s (cooldown %ds)\n",
+                   pressure_resource_str(t->resource), t->full ? "full" : "some",
+                   t->stall_ms, t->window_ms, pressure_action_str(t->action), p->pressure_cooldown);
+        }
+        printf("  rotation: stdout %ld bytes x%d, stderr %ld bytes x%d\n",
+               p->stdout_maxbytes, p->stdout_backups, p->stderr_maxbytes, p->stderr_backups);
         printf("\n");
     }
 
      // run supervisor
-    supervisor_run(&config);
+    supervisor_run(&config, config_file);
+    free_config(&config);
 
     return 0;
 }
@@ -0,0 +1,136 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SUB_COUNT (1u << HIST_SUB_BITS)
+// exported le bounds: 2^k - 1us for k from 4 (15us) to 34 (~4.8h)
+#define EXPORT_FIRST_OCTAVE 4
+#define EXPORT_LAST_OCTAVE 34
+
+
+// values below SUB_COUNT get a bucket each; above, the top
+// HIST_SUB_BITS bits after the leading one pick the sub-bucket
+static size_t hist_index(uint64_t v) {
+    if (v < SUB_COUNT) return (size_t)v;
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    size_t idx = ((size_t)(shift + 1) << HIST_SUB_BITS) + (size_t)((v >> shift) & (SUB_COUNT - 1));
+    return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+// largest value that lands in bucket idx
+static uint64_t bucket_upper(size_t idx) {
+    if (idx < SUB_COUNT) return idx;
+    int shift = (int)(idx >> HIST_SUB_BITS) - 1;
+    uint64_t lower = (uint64_t)(SUB_COUNT + (idx & (SUB_COUNT - 1))) << shift;
+    return lower + (1ull << shift) - 1;
+}
+
+void hist_record(histogram_t *h, uint64_t us) {
+    h->counts[hist_index(us)]++;
+    h->count++;
+    h->sum_us += us;
+    if (us > h->max_us) h->max_us = us;
+}
+
+uint64_t hist_quantile(const histogram_t *h, double q) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)h->count + 0.5), seen = 0;
+    if (rank == 0) rank = 1;
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) return bucket_upper(i) < h->max_us ? bucket_upper(i) : h->max_us;
+    }
+    return h->max_us;
+}
+
+
+void metrics_printf(metrics_buf_t *b, const char *fmt, ...) {
+    va_list ap;
+    for (;;) {
+        size_t room = b->cap - b->len;
+        va_start(ap, fmt);
+        int n = vsnprintf(b->data ? b->data + b->len : NULL, room, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if ((size_t)n < room) {
+            b->len += (size_t)n;
+            return;
+        }
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap - b->len <= (size_t)n) cap *= 2;
+        char *d = realloc(b->data, cap);
+        if (!d) return;
+        b->data = d;
+        b->cap = cap;
+    }
+}
+
+void metrics_header(metrics_buf_t *b, const char *name, const char *type, const char *help) {
+    metrics_printf(b, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// label values escape backslash, quote and newline
+void metrics_label(metrics_buf_t *b, const char *value) {
+    if (!strpbrk(value, "\\\"\n")) {
+        metrics_printf(b, "%s", value);
+        return;
+    }
+    for (const char *c = value; *c; c++) {
+        if (*c == '\n') metrics_printf(b, "\\n");
+        else if (*c == '\\' || *c == '"') metrics_printf(b, "\\%c", *c);
+        else metrics_printf(b, "%c", *c);
+    }
+}
+
+// cumulative buckets in seconds. le is inclusive, so each bound is
+// 2^k - 1us, the last value of an octave and so a real bucket edge
+void metrics_histogram(metrics_buf_t *b, const char *name, const char *help, const histogram_t *h) {
+    metrics_header(b, name, "histogram", help);
+
+    uint64_t cumulative = 0;
+    size_t idx = 0;
+    for (int k = EXPORT_FIRST_OCTAVE; k <= EXPORT_LAST_OCTAVE; k++) {
+        uint64_t bound = (1ull << k) - 1;
+        while (idx < HIST_BUCKETS && bucket_upper(idx) <= bound)
+            cumulative += h->counts[idx++];
+        metrics_printf(b, "%s_bucket{le=\"%.9g\"} %llu\n", name, (double)bound / 1e6,
+                       (unsigned long long)cumulative);
+    }
+    metrics_printf(b, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)h->count);
+    metrics_printf(b, "%s_sum %.6f\n", name, (double)h->sum_us / 1e6);
+    metrics_printf(b, "%s_count %llu\n", name, (unsigned long long)h->count);
+}
+
+// scrapers never see a half-written file
+int metrics_write_file(const char *path, const metrics_buf_t *b) {
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return -1;
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+
+    size_t off = 0;
+    while (off < b->len) {
+        ssize_t n = write(fd, b->data + off, b->len - off);
+        if (n <= 0) {
+            close(fd);
+            unlink(tmp);
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    if (close(fd) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_free(metrics_buf_t *b) {
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
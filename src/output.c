@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include "output.h"
+#include "event.h"
+#include "logging.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PIPE_SIZE (1024 * 1024)
+#define SPLICE_CHUNK (1024 * 1024)
+#define SPLICES_PER_WAKEUP 16     // bound one chatty program's share of the loop
+#define REOPEN_RETRY_US 1000000   // a lost log file is reopened at most once a second
+
+
+// splice() refuses O_APPEND targets, so track the end of file ourselves
+static int open_log_file(output_pipe_t *o) {
+    o->file_fd = open(o->path, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+    if (o->file_fd < 0) return -1;
+
+    off_t end = lseek(o->file_fd, 0, SEEK_END);
+    o->size = end > 0 ? (long)end : 0;
+    return 0;
+}
+
+
+// path.N-1 -> path.N ... path -> path.1, then start a fresh file
+static void rotate(output_pipe_t *o) {
+    size_t len = strlen(o->path) + 16;
+    char from[len], to[len];
+
+    if (o->backups <= 0) {
+        // nowhere to keep history: truncate in place
+        if (ftruncate(o->file_fd, 0) == 0) lseek(o->file_fd, 0, SEEK_SET);
+        o->size = 0;
+        return;
+    }
+
+    for (int k = o->backups - 1; k >= 1; k--) {
+        snprintf(from, len, "%s.%d", o->path, k);
+        snprintf(to, len, "%s.%d", o->path, k + 1);
+        rename(from, to);   // missing generations are fine
+    }
+    snprintf(to, len, "%s.1", o->path);
+    if (rename(o->path, to) != 0)
+        log_message("Failed to rotate %s: %s\n", o->path, strerror(errno));
+
+    close(o->file_fd);
+    if (open_log_file(o) != 0) {
+        log_message("Failed to reopen %s: %s\n", o->path, strerror(errno));
+        o->retry_us = now_us() + REOPEN_RETRY_US;
+    }
+}
+
+// no log file: retry the open now and then, and until it works read the
+// pipe empty so the child never blocks and EPOLLIN doesn't spin
+static int discard(output_pipe_t *o, int budget) {
+    if (now_us() >= o->retry_us) {
+        if (open_log_file(o) == 0) {
+            log_message("Reopened %s, %ld bytes of output lost\n", o->path, o->dropped);
+            o->dropped = 0;
+            return 1;
+        }
+        o->retry_us = now_us() + REOPEN_RETRY_US;
+    }
+
+    char buf[65536];
+    while (budget-- > 0) {
+        ssize_t n = read(o->read_fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return (n < 0 && errno != EAGAIN) ? -1 : 0;
+        }
+        o->dropped += n;
+    }
+    return 0;
+}
+
+
+static int drain(output_pipe_t *o, int budget) {
+    while (budget-- > 0) {
+        if (o->file_fd < 0) {
+            int rc = discard(o, budget + 1);
+            if (rc != 1) return rc;
+        }
+
+        ssize_t n = splice(o->read_fd, NULL, o->file_fd, NULL, SPLICE_CHUNK,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return (n < 0 && errno != EAGAIN) ? -1 : 0;
+        }
+
+        o->size += n;
+        if (o->maxbytes > 0 && o->size >= o->maxbytes)
+            rotate(o);
+    }
+    return 0;
+}
+
+
+static void on_output(int fd, uint32_t events, void *ctx) {
+    (void)fd;
+    (void)events;
+    output_pipe_t *o = ctx;
+    if (drain(o, SPLICES_PER_WAKEUP) != 0)
+        log_message("Output pipe for %s failed: %s\n", o->path, strerror(errno));
+}
+
+
+output_pipe_t *output_open(const char *path, long maxbytes, int backups) {
+    output_pipe_t *o = calloc(1, sizeof(*o));
+    if (!o) return NULL;
+
+    int fds[2];
+    o->read_fd = o->write_fd = o->file_fd = -1;
+    o->path = strdup(path);
+    o->maxbytes = maxbytes;
+    o->backups = backups;
+
+    if (!o->path || pipe2(fds, O_CLOEXEC) != 0) {
+        free(o->path);
+        free(o);
+        return NULL;
+    }
+    o->read_fd = fds[0];
+    o->write_fd = fds[1];
+
+    // only our end is non-blocking; a full pipe just pushes back on the child
+    fcntl(o->read_fd, F_SETFL, O_NONBLOCK);
+    fcntl(o->read_fd, F_SETPIPE_SZ, PIPE_SIZE);   // best effort
+
+    if (open_log_file(o) != 0 ||
+        event_add(o->read_fd, EPOLLIN, on_output, o) != 0) {
+        int saved = errno;
+        output_close(o);
+        errno = saved;
+        return NULL;
+    }
+    return o;
+}
+
+
+void output_close(output_pipe_t *o) {
+    if (!o) return;
+
+    if (o->write_fd >= 0) close(o->write_fd);
+    if (o->read_fd >= 0) {
+        event_del(o->read_fd);
+        drain(o, 1 << 20);   // flush whatever the children left behind
+        close(o->read_fd);
+    }
+    if (o->file_fd >= 0) close(o->file_fd);
+    free(o->path);
+    free(o);
+}
@@ -0,0 +1,102 @@
+#include "pidmap.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+// linear probing with backward-shift deletion, kept at most half full
+
+static size_t bucket(const pidmap_t *m, int key) {
+    return ((uint32_t)key * 2654435761u) & (m->cap - 1);
+}
+
+
+static int grow(pidmap_t *m) {
+    size_t cap = m->cap ? m->cap * 2 : 64;
+    int *keys = malloc(cap * sizeof(int));
+    size_t *vals = malloc(cap * sizeof(size_t));
+    if (!keys || !vals) {
+        free(keys);
+        free(vals);
+        return -1;
+    }
+    for (size_t i = 0; i < cap; i++) keys[i] = -1;
+
+    int *old_keys = m->keys;
+    size_t *old_vals = m->vals;
+    size_t old_cap = m->cap;
+
+    m->keys = keys;
+    m->vals = vals;
+    m->cap = cap;
+    m->len = 0;
+
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old_keys[i] >= 0) pidmap_put(m, old_keys[i], old_vals[i]);
+    }
+    free(old_keys);
+    free(old_vals);
+    return 0;
+}
+
+
+int pidmap_put(pidmap_t *m, int key, size_t slot) {
+    if (key < 0) return -1;
+    if ((m->len + 1) * 2 > m->cap && grow(m) != 0) return -1;
+
+    size_t i = bucket(m, key);
+    while (m->keys[i] >= 0 && m->keys[i] != key)
+        i = (i + 1) & (m->cap - 1);
+
+    if (m->keys[i] < 0) m->len++;
+    m->keys[i] = key;
+    m->vals[i] = slot;
+    return 0;
+}
+
+
+long pidmap_get(const pidmap_t *m, int key) {
+    if (!m->cap || key < 0) return -1;
+
+    size_t i = bucket(m, key);
+    while (m->keys[i] >= 0) {
+        if (m->keys[i] == key) return (long)m->vals[i];
+        i = (i + 1) & (m->cap - 1);
+    }
+    return -1;
+}
+
+
+void pidmap_remove(pidmap_t *m, int key) {
+    if (!m->cap || key < 0) return;
+
+    size_t mask = m->cap - 1;
+    size_t i = bucket(m, key);
+    while (m->keys[i] != key) {
+        if (m->keys[i] < 0) return;
+        i = (i + 1) & mask;
+    }
+
+    // shift later members of the probe run back into the hole
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (m->keys[j] < 0) break;
+        size_t home = bucket(m, m->keys[j]);
+        // move j to i unless its home lies cyclically in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m->keys[i] = m->keys[j];
+            m->vals[i] = m->vals[j];
+            i = j;
+        }
+    }
+    m->keys[i] = -1;
+    m->len--;
+}
+
+
+void pidmap_free(pidmap_t *m) {
+    free(m->keys);
+    free(m->vals);
+    m->keys = NULL;
+    m->vals = NULL;
+    m->cap = m->len = 0;
+}
@@ -0,0 +1,62 @@
+#include "pressure.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+int pressure_open(const char *path) {
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// "some avg10=1.23 avg60=... total=..." is the first line; the file
+// stays open and is re-read from offset 0
+int pressure_read(int fd, double *some_avg10) {
+    char buf[256];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0) return -1;
+    buf[n] = '\0';
+
+    const char *p = strstr(buf, "some avg10=");
+    if (!p) return -1;
+    *some_avg10 = strtod(p + 11, NULL);
+    return 0;
+}
+
+
+int pressure_trigger(int dirfd, const char *file, int full, unsigned stall_us, unsigned window_us) {
+    char value[64];
+    int len = snprintf(value, sizeof(value), "%s %u %u", full ? "full" : "some", stall_us, window_us);
+
+    int fd = openat(dirfd, file, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+    // the trigger is registered by the write, NUL included
+    if (write(fd, value, (size_t)len + 1) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+const char *pressure_resource_str(pressure_resource_t r) {
+    switch (r) {
+        case PRESSURE_MEMORY: return "memory";
+        case PRESSURE_CPU: return "cpu";
+        case PRESSURE_IO: return "io";
+        default: return "unknown";
+    }
+}
+
+const char *pressure_action_str(pressure_action_t a) {
+    switch (a) {
+        case PRESSURE_LOG: return "log";
+        case PRESSURE_THROTTLE: return "throttle";
+        case PRESSURE_FREEZE: return "freeze";
+        case PRESSURE_RESTART: return "restart";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,112 @@
+#include "sampler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+enum { F_MEM_CURRENT, F_MEM_PEAK, F_MEM_STAT, F_CPU_STAT, F_IO_STAT, F_COUNT };
+
+static const char *const stat_files[F_COUNT] = {
+    "memory.current", "memory.peak", "memory.stat", "cpu.stat", "io.stat",
+};
+
+
+// files stay open; each sample is a single pread per file
+sampler_t *sampler_open(int cgroup_dirfd) {
+    sampler_t *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+
+    for (int i = 0; i < F_COUNT; i++)   // missing controllers just read as 0
+        s->fds[i] = openat(cgroup_dirfd, stat_files[i], O_RDONLY | O_CLOEXEC);
+    return s;
+}
+
+
+static ssize_t read_file(int fd, char *buf, size_t len) {
+    if (fd < 0) return -1;
+    ssize_t n = pread(fd, buf, len - 1, 0);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+
+static uint64_t read_value(int fd) {
+    char buf[32];
+    if (read_file(fd, buf, sizeof(buf)) < 0) return 0;
+    return strtoull(buf, NULL, 10);   // "max" and friends parse as 0
+}
+
+
+// value of "key N" in a flat keyed file such as memory.stat or cpu.stat
+static uint64_t keyed(const char *buf, const char *key) {
+    size_t klen = strlen(key);
+    for (const char *line = buf; line && *line; ) {
+        if (strncmp(line, key, klen) == 0 && line[klen] == ' ')
+            return strtoull(line + klen + 1, NULL, 10);
+        line = strchr(line, '\n');
+        if (line) line++;
+    }
+    return 0;
+}
+
+
+// io.stat: "MAJ:MIN rbytes=N wbytes=N rios=N ..." per device
+static void sum_io(const char *buf, uint64_t *rbytes, uint64_t *wbytes) {
+    *rbytes = *wbytes = 0;
+    for (const char *p = buf; (p = strstr(p, "bytes=")) != NULL; p += 6) {
+        uint64_t v = strtoull(p + 6, NULL, 10);
+        if (p > buf && p[-1] == 'r') *rbytes += v;
+        else if (p > buf && p[-1] == 'w') *wbytes += v;
+    }
+}
+
+
+void sampler_read(sampler_t *s, uint32_t t) {
+    char buf[4096];
+    resource_sample_t *r = &s->ring[s->head];
+    memset(r, 0, sizeof(*r));
+    r->t = t;
+
+    r->mem_current_kb = (uint32_t)(read_value(s->fds[F_MEM_CURRENT]) / 1024);
+    r->mem_peak_kb = (uint32_t)(read_value(s->fds[F_MEM_PEAK]) / 1024);
+
+    if (read_file(s->fds[F_MEM_STAT], buf, sizeof(buf)) > 0) {
+        r->mem_anon_kb = (uint32_t)(keyed(buf, "anon") / 1024);
+        r->mem_file_kb = (uint32_t)(keyed(buf, "file") / 1024);
+    }
+    if (read_file(s->fds[F_CPU_STAT], buf, sizeof(buf)) > 0) {
+        r->cpu_usage_usec = keyed(buf, "usage_usec");
+        r->cpu_throttled_usec = keyed(buf, "throttled_usec");
+    }
+    if (read_file(s->fds[F_IO_STAT], buf, sizeof(buf)) > 0)
+        sum_io(buf, &r->io_rbytes, &r->io_wbytes);
+
+    s->head = (s->head + 1) % SAMPLE_HISTORY;
+    if (s->count < SAMPLE_HISTORY) s->count++;
+}
+
+
+const resource_sample_t *sampler_latest(const sampler_t *s) {
+    if (!s || s->count == 0) return NULL;
+    return &s->ring[(s->head + SAMPLE_HISTORY - 1) % SAMPLE_HISTORY];
+}
+
+
+size_t sampler_history(const sampler_t *s, resource_sample_t *out, size_t max) {
+    if (!s) return 0;
+    size_t n = s->count < max ? s->count : max;
+    size_t start = (s->head + SAMPLE_HISTORY - n) % SAMPLE_HISTORY;
+    for (size_t i = 0; i < n; i++)
+        out[i] = s->ring[(start + i) % SAMPLE_HISTORY];
+    return n;
+}
+
+
+void sampler_close(sampler_t *s) {
+    if (!s) return;
+    for (int i = 0; i < F_COUNT; i++)
+        if (s->fds[i] >= 0) close(s->fds[i]);
+    free(s);
+}
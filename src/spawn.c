@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+#include "spawn.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+#define CHILD_STACK_SIZE (64 * 1024)
+
+extern char **environ;
+
+// mirror of the kernel's struct clone_args (v2, with cgroup)
+struct clone3_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+static int clone3_unsupported = 0;
+static void *child_stack = NULL;   // shared by vfork-style children, parent is suspended
+// the child fills in its own pid; a vfork-style child writes the
+// parent's copy, which is harmless as it is rewritten every spawn
+static char listen_pid_env[32] = "LISTEN_PID=";
+#define LISTEN_PID_DIGITS 11
+
+
+const char *spawn_engine_str(spawn_engine_t e) {
+    switch (e) {
+        case SPAWN_AUTO: return "auto";
+        case SPAWN_CLONE3: return "clone3";
+        case SPAWN_VFORK: return "vfork";
+        case SPAWN_FORK: return "fork";
+        default: return "unknown";
+    }
+}
+
+
+static void child_fail(const char *what, const char *arg) {
+    // async-signal-safe: no stdio in a child sharing our memory
+    const char *msg = strerror(errno);
+    if (write(STDERR_FILENO, what, strlen(what)) < 0) {}
+    if (arg) {
+        if (write(STDERR_FILENO, " ", 1) < 0) {}
+        if (write(STDERR_FILENO, arg, strlen(arg)) < 0) {}
+    }
+    if (write(STDERR_FILENO, ": ", 2) < 0) {}
+    if (write(STDERR_FILENO, msg, strlen(msg)) < 0) {}
+    if (write(STDERR_FILENO, "\n", 1) < 0) {}
+}
+
+
+// sockets land on 3, 4, ... without CLOEXEC; they are moved above that
+// range first so no source is overwritten before it is copied
+static void pass_listen_fds(const spawn_req_t *req) {
+    int n = req->listen_count, tmp[n];
+    for (int i = 0; i < n; i++)
+        tmp[i] = fcntl(req->listen_fds[i], F_DUPFD, 3 + n);
+    for (int i = 0; i < n; i++) {
+        if (tmp[i] < 0 || dup2(tmp[i], 3 + i) < 0) child_fail("listen fd failed:", NULL);
+        close(tmp[i]);
+    }
+
+    char *d = listen_pid_env + LISTEN_PID_DIGITS;
+    char digits[16];
+    int len = 0;
+    for (pid_t pid = getpid(); pid > 0; pid /= 10)
+        digits[len++] = (char)('0' + pid % 10);
+    while (len > 0) *d++ = digits[--len];
+    *d = '\0';
+}
+
+// runs in the child between clone and exec; only async-signal-safe calls
+static void child_exec(const spawn_req_t *req) {
+    setpgid(0, 0);
+    if (req->sigmask) sigprocmask(SIG_SETMASK, req->sigmask, NULL);
+
+    if (req->stdout_fd >= 0) dup2(req->stdout_fd, STDOUT_FILENO);
+    if (req->stderr_fd >= 0) dup2(req->stderr_fd, STDERR_FILENO);
+    if (req->listen_count > 0) pass_listen_fds(req);
+
+    execve(req->path, req->argv, req->envp ? req->envp : environ);
+    child_fail("exec failed:", req->path);
+    _exit(127);
+}
+
+
+// vfork-style child: move ourselves into the cgroup before exec, so the
+// program never runs a single instruction outside its limits; if it
+// can't join, it doesn't run at all
+static int join_and_exec(void *arg) {
+    const spawn_req_t *req = arg;
+
+    if (req->cgroup_fd >= 0) {
+        int fd = openat(req->cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write(fd, "0", 1) != 1) {
+            child_fail("cgroup join failed:", req->path);
+            _exit(127);
+        }
+        close(fd);
+    }
+    child_exec(req);
+    return 127;
+}
+
+
+static pid_t spawn_clone3(const spawn_req_t *req, int *pidfd) {
+    struct clone3_args args;
+    memset(&args, 0, sizeof(args));
+    args.flags = CLONE_PIDFD;
+    args.pidfd = (uint64_t)(uintptr_t)pidfd;
+    args.exit_signal = SIGCHLD;
+    if (req->cgroup_fd >= 0) {
+        args.flags |= CLONE_INTO_CGROUP;
+        args.cgroup = (uint64_t)req->cgroup_fd;
+    }
+
+    pid_t pid = (pid_t)syscall(SYS_clone3, &args, sizeof(args));
+    if (pid == 0) child_exec(req);
+    return pid;
+}
+
+
+static pid_t spawn_vfork(const spawn_req_t *req, int *pidfd) {
+    if (!child_stack) {
+        child_stack = mmap(NULL, CHILD_STACK_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (child_stack == MAP_FAILED) {
+            child_stack = NULL;
+            return -1;
+        }
+    }
+
+    // CLONE_PIDFD hands the pidfd back through the parent_tid argument
+    return clone(join_and_exec, (char *)child_stack + CHILD_STACK_SIZE,
+                 CLONE_VM | CLONE_VFORK | CLONE_PIDFD | SIGCHLD,
+                 (void *)req, pidfd);
+}
+
+
+static pid_t spawn_fork(const spawn_req_t *req, int *pidfd) {
+    pid_t pid = fork();
+    if (pid == 0) join_and_exec((void *)req);
+    if (pid > 0) *pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    return pid;
+}
+
+
+// environment plus LISTEN_FDS and the LISTEN_PID slot, dropping any
+// LISTEN_* the supervisor itself inherited
+static char **listen_env(const spawn_req_t *req, char *fds_env, size_t fds_len) {
+    char *const *env = req->envp ? req->envp : environ;
+    size_t n = 0;
+    while (env[n]) n++;
+
+    char **out = malloc((n + 3) * sizeof(char *));
+    if (!out) return NULL;
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (strncmp(env[i], "LISTEN_", 7) != 0) out[k++] = env[i];
+    }
+    snprintf(fds_env, fds_len, "LISTEN_FDS=%d", req->listen_count);
+    out[k++] = fds_env;
+    out[k++] = listen_pid_env;
+    out[k] = NULL;
+    return out;
+}
+
+static pid_t spawn_any(const spawn_req_t *req, int *pidfd);
+
+pid_t spawn_process(const spawn_req_t *req, int *pidfd) {
+    *pidfd = -1;
+    pid_t pid;
+    if (req->listen_count <= 0) {
+        pid = spawn_any(req, pidfd);
+    } else {
+        char fds_env[32];
+        spawn_req_t with_env = *req;
+        char **env = listen_env(req, fds_env, sizeof(fds_env));
+        if (!env) return -1;
+        with_env.envp = env;
+        pid = spawn_any(&with_env, pidfd);
+        free(env);
+    }
+
+    // the child sets its group too, but a clone3 child may not have run
+    // yet; from both sides the group exists once we return, so -pid can
+    // be signalled right away. EACCES: it already exec'd, having done it
+    if (pid > 0) setpgid(pid, pid);
+    return pid;
+}
+
+static pid_t spawn_any(const spawn_req_t *req, int *pidfd) {
+    switch (req->engine) {
+        case SPAWN_CLONE3: return spawn_clone3(req, pidfd);
+        case SPAWN_VFORK: return spawn_vfork(req, pidfd);
+        case SPAWN_FORK: return spawn_fork(req, pidfd);
+        default: break;
+    }
+
+    // auto: only pay for the fork-style copy when the kernel can place
+    // the child in its cgroup for us. a kernel without clone3 or
+    // CLONE_INTO_CGROUP falls back to vfork for good; EBADF means the fd
+    // is no cgroup2 directory at all, so the program runs without one as
+    // it would with no cgroup. anything else (EBUSY, EACCES, ...) is the
+    // cgroup's fault and goes to the caller
+    if (req->cgroup_fd >= 0 && !clone3_unsupported) {
+        pid_t pid = spawn_clone3(req, pidfd);
+        if (pid >= 0) return pid;
+        *pidfd = -1;
+        if (errno == EBADF) {
+            spawn_req_t bare = *req;
+            bare.cgroup_fd = -1;
+            return spawn_vfork(&bare, pidfd);
+        }
+        if (errno != ENOSYS && errno != E2BIG && errno != EINVAL) return -1;
+        clone3_unsupported = 1;
+    }
+    return spawn_vfork(req, pidfd);
+}
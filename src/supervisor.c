@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "supervisor.h"
 #include "logging.h"
 #include <stdio.h>
@@ -6,24 +7,148 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
+#include <errno.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sched.h>
 #include "cgroup.h"
+#include "event.h"
+#include "timer.h"
+#include "pidmap.h"
+#include "spawn.h"
+#include "output.h"
+#include "sampler.h"
+#include "control.h"
+#include "health.h"
+#include "metrics.h"
+#include "pressure.h"
 
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
+
+// a run at least this long resets the backoff streak
+#define BACKOFF_RESET_SEC 10
+// growth base when restart_delay is 0 but backoff_factor > 1
+#define BACKOFF_MIN_MS 100
+// probe cadence until the first pass, so readiness isn't a full interval late
+#define HEALTH_FIRST_MS 1000
+// least time a standby or rolling replacement runs before it may take over
+#define SPARE_WARMUP_MS 1000
+// host pressure checks for the freeze policy; the kernel updates avg10
+// every 2s
+#define PRESSURE_CHECK_MS 2000
+
+// a process that no longer owns a slot (replaced by a handover, or a
+// stale standby) on its way out; its exit only has to be reaped
+typedef struct drain {
+    pid_t pid;
+    int pidfd;                    // -1 when exits come through SIGCHLD
+    int timer;                    // SIGKILL escalation
+    struct drain *next;
+} drain_t;
 
 static int running = 1;
-static program_runtime_t runtime[MAX_PROGRAMS];
+static supervisor_config_t *cfg = NULL;
+
+// runtime registry: slots are never moved between programs, so a slot
+// index stays valid as a timer/event context for the slot's lifetime
+static program_runtime_t *runtime = NULL;
+static size_t runtime_count = 0;
+static size_t runtime_cap = 0;
+static pidmap_t pid_index;        // pid -> slot
+static pidmap_t pidfd_index;      // pidfd -> slot
+
+static int signal_fd = -1;
+static int have_pidfd = 1;        // 0 -> fall back to SIGCHLD via signalfd
+static int cgroups_unavailable = 0;   // a program without limits failed to get one
+static int no_cgroup2 = 0;            // the cgroup root is not a cgroup2 mount
+static sigset_t orig_mask;        // restored in children before exec
+static uint64_t start_ms;         // supervisor start, sample time base
+static int sample_timer = -1;
+static const char *cfg_path = NULL;   // re-read on SIGHUP
+static size_t stopping_count = 0;     // children signalled but not yet reaped
+static size_t *prog_slot = NULL;      // program index -> slot, for dependency edges
+static size_t boot_pending = 0;       // autostart programs not yet ready once
+static int metrics_timer = -1;
+static int pressure_timer = -1;
+static int host_memory_pressure = -1;   // /proc/pressure/* while the freeze policy is on
+static int host_cpu_pressure = -1;
+static drain_t *drains = NULL;
+static metrics_buf_t metrics_out;     // reused by every render
+static histogram_t spawn_hist;        // spawn_program: cgroup, pipes, clone
+static histogram_t restart_hist;      // exit to replacement spawn, backoff included
+static histogram_t loop_hist;         // one event loop wakeup: dispatch and log flush
+
+static void on_child_exit(int fd, uint32_t events, void *ctx);
+static void on_memory_events(int fd, uint32_t events, void *ctx);
+static void on_cgroup_events(int fd, uint32_t events, void *ctx);
+static void on_pressure_trigger(int fd, uint32_t events, void *ctx);
+static void reload_config(void);
+static void stop_program(size_t slot);
+static void mark_ready(size_t slot);
+static void on_ready_timer(void *ctx);
+static void schedule_health(size_t slot, uint64_t delay_ms);
+static void stop_health(program_runtime_t *r);
+static void spawn_spare(size_t slot);
+static void drop_spare(size_t slot);
+static void handover(size_t slot, uint64_t exited_us);
+static void restart_running(size_t slot);
+static int set_frozen(size_t slot, freeze_reason_t why);
+
+static int pidfd_open(pid_t pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
 
-// signal handler
-static void handle_signal(int sig) {
-    (void)sig;
-    running = 0;
+// sig to pid's process group; a child that hasn't joined its group yet
+// (or left it) still gets it, through its pidfd or pid
+static int signal_tree(pid_t pid, int pidfd, int sig) {
+    if (kill(-pid, sig) == 0) return 0;
+    if (pidfd >= 0) return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+    return kill(pid, sig);
+}
+
+static program_config_t *slot_program(size_t slot) {
+    return &cfg->programs[runtime[slot].prog];
+}
+
+// append a fresh slot for program index prog, returns slot or -1
+static long alloc_slot(size_t prog) {
+    if (runtime_count == runtime_cap) {
+        size_t cap = runtime_cap ? runtime_cap * 2 : 16;
+        program_runtime_t *grown = realloc(runtime, cap * sizeof(program_runtime_t));
+        if (!grown) return -1;
+        runtime = grown;
+        runtime_cap = cap;
+    }
+
+    program_runtime_t *r = &runtime[runtime_count];
+    memset(r, 0, sizeof(*r));
+    r->prog = prog;
+    r->pidfd = -1;
+    r->state = STATE_STOPPED;
+    r->restart_timer = -1;
+    r->stop_timer = -1;
+    r->ready_timer = -1;
+    r->health_timer = -1;
+    r->trigger_timer = -1;
+    r->spare.pidfd = -1;
+    r->spare.timer = -1;
+    cgroup_init(&r->cg);
+    cgroup_init(&r->spare.cg);
+    return (long)runtime_count++;
 }
 
 // timestamp helper
 static void timestamp(char *buf, size_t len) {
-    time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    strftime(buf, len, "%Y-%m-%d %H:%M:%S", t);
+    snprintf(buf, len, "%s", log_timestamp());   // shares the logger's per-second cache
 }
 
 static const char* state_to_str(program_state_t s) {
@@ -34,257 +159,2201 @@ static const char* state_to_str(program_state_t s) {
         case STATE_EXITED: return "EXITED";
         case STATE_FAILED: return "FAILED";
         case STATE_KILLED: return "KILLED";
+        case STATE_BACKOFF: return "BACKOFF";
+        case STATE_OOM: return "OOM_KILLED";
+        case STATE_STOPPING: return "STOPPING";
+        case STATE_WAITING: return "WAITING";
+        case STATE_UNHEALTHY: return "UNHEALTHY";
+        case STATE_FROZEN: return "FROZEN";
         default: return "UNKNOWN";
     }
 }
 
 
-static const char* sig_to_str(int sig) {
-    switch(sig) {
-        case SIGINT: return "SIGINT";
-        case SIGTERM: return "SIGTERM";
-        case SIGKILL: return "SIGKILL";
-        case SIGHUP: return "SIGHUP";
-        case SIGQUIT: return "SIGQUIT";
-        default: return "UNKNOWN";
+// forget a reaped child and drop its pidfd
+static void release_pid(program_runtime_t *r) {
+    pidmap_remove(&pid_index, r->pid);
+    if (r->pidfd >= 0) {
+        pidmap_remove(&pidfd_index, r->pidfd);
+        event_del(r->pidfd);
+        close(r->pidfd);
     }
+    r->pidfd = -1;
+    r->pid = 0;
 }
 
-// shutdown all children gracefully
-static void shutdown_children(supervisor_config_t *config, int timeout_sec) {
-    char ts[64];
+// close the PSI triggers; the kernel drops them with the fd
+static void disarm_pressure(program_runtime_t *r) {
+    for (int k = 0; k < r->psi_count; k++) {
+        if (r->psi_fds[k] < 0) continue;
+        event_del(r->psi_fds[k]);
+        close(r->psi_fds[k]);
+    }
+    r->psi_count = 0;
+}
 
-    printf("\nStarting Shutdown! This might take a few seconds.\n");
-    log_message("\nStarting Shutdown! This might take a few seconds.\n");
+// close (and remove) a slot's cgroup, logging what the kernel refused
+static void close_cgroup(program_runtime_t *r, cgroup_t *cg) {
+    cgroup_error_t err;
+    if (cgroup_close(cg, 1, &err) != 0) {
+        char msg[128];
+        cgroup_strerror(&err, msg, sizeof(msg));
+        log_message("Failed to remove cgroup of %s: %s\n", cfg->programs[r->prog].name, msg);
+    }
+}
 
-    for (size_t i = 0; i < config->count; i++) {
-        if (runtime[i].pid > 0) {
-            timestamp(ts, sizeof(ts));
-            printf("[%s] Sending SIGTERM to %s (PID %d, state=%s)\n",
-                   ts, config->programs[i].name, runtime[i].pid, state_to_str(runtime[i].state));
-            kill(-runtime[i].pid, SIGTERM); 
-        }
-    }
-
-    time_t start = time(NULL);
-    int remaining = config->count;
-
-    while (remaining > 0 && (time(NULL) - start) < timeout_sec) {
-        int status;
-        pid_t pid;
-        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-            for (size_t i = 0; i < config->count; i++) {
-                if (runtime[i].pid == pid) {
-                    program_config_t *p = &config->programs[i];
-                    timestamp(ts, sizeof(ts));
-
-                    int exit_status;
-                    if (WIFEXITED(status))
-                        exit_status = WEXITSTATUS(status);
-                    else if (WIFSIGNALED(status)) {
-                        int sig = WTERMSIG(status);
-                        exit_status = -sig;
-                        runtime[i].state = STATE_KILLED;
-                        printf("[%s] %s (PID %d, state=%s) killed by %s\n",
-                               ts, p->name, pid, state_to_str(runtime[i].state), sig_to_str(sig));
-                        log_message(" %s (PID %d, state=%s) killed by %s\n",
-                                p->name, pid, state_to_str(runtime[i].state), sig_to_str(sig));
-                        runtime[i].pid = 0;
-                        remaining--;
-                        continue;
-                    } 
-                    else
-                        exit_status = -1;
-
-                    runtime[i].state = (exit_status == 0) ? STATE_EXITED : STATE_FAILED;
-                    printf("[%s] %s (PID %d, state=%s) exited with %d\n",
-                           ts, p->name, pid, state_to_str(runtime[i].state), exit_status);
-                    log_message(" %s (PID %d, state=%s) exited with %d\n",
-                            p->name, pid, state_to_str(runtime[i].state), exit_status);
-                    runtime[i].pid = 0;
-                    remaining--;
-                }
-            }
+// drop everything a slot holds besides its child
+static void release_slot(program_runtime_t *r) {
+    disarm_pressure(r);
+    timer_cancel(r->trigger_timer);
+    r->trigger_timer = -1;
+    sampler_close(r->sampler);
+    r->sampler = NULL;
+    event_del(r->cg.events_fd);
+    event_del(r->cg.state_fd);
+    close_cgroup(r, &r->cg);
+    output_close(r->out);
+    output_close(r->err);
+    r->out = r->err = NULL;
+    stop_health(r);
+    health_free(r->health);
+    r->health = NULL;
+    health_free(r->spare.health);
+    r->spare.health = NULL;
+    close_cgroup(r, &r->spare.cg);
+    if (r->listen) listen_close(r->listen);
+    free(r->listen);
+    r->listen = NULL;
+    r->listen_count = 0;
+}
+
+// memory.events tells us about OOM kills the moment they happen
+static void watch_memory_events(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+
+    if (r->cg.dirfd >= 0 && r->cg.events_fd < 0 && slot_program(slot)->memory_limit_bytes > 0) {
+        cgroup_error_t err;
+        if (cgroup_watch_events(&r->cg, &err) == 0)
+            event_add(r->cg.events_fd, EPOLLPRI, on_memory_events, (void *)(uintptr_t)slot);
+    }
+}
+
+// cgroup.events tells us when everything the program started is gone
+static void watch_cgroup_state(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+
+    if (r->cg.dirfd >= 0 && r->cg.state_fd < 0) {
+        cgroup_error_t err;
+        if (cgroup_watch_state(&r->cg, &err) == 0)
+            event_add(r->cg.state_fd, EPOLLPRI, on_cgroup_events, (void *)(uintptr_t)slot);
+    }
+}
+
+// one PSI trigger per pressure_trigger entry on the program's own
+// cgroup, armed once per slot and again when a reload changes them. the
+// epoll ctx carries slot and trigger index
+static void arm_pressure(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    disarm_pressure(r);
+    if (r->cg.dirfd < 0) return;
+    for (int k = 0; k < p->pressure_count; k++) {
+        const pressure_trigger_t *t = &p->pressure[k];
+        char file[32];
+        snprintf(file, sizeof(file), "%s.pressure", pressure_resource_str(t->resource));
+        int fd = pressure_trigger(r->cg.dirfd, file, t->full,
+                                  (unsigned)t->stall_ms * 1000u, (unsigned)t->window_ms * 1000u);
+        if (fd < 0 || event_add(fd, EPOLLPRI, on_pressure_trigger,
+                                (void *)(uintptr_t)(slot * MAX_PRESSURE_TRIGGERS + (size_t)k)) != 0) {
+            // without CAP_SYS_RESOURCE the kernel only takes whole 2s windows
+            log_message("Failed to arm %s trigger for %s: %s%s\n", file, p->name, strerror(errno),
+                        errno == EINVAL && t->window_ms % 2000 ? " (window not a multiple of 2s, "
+                        "which is all the kernel allows without CAP_SYS_RESOURCE)" : "");
+            if (fd >= 0) close(fd);
+            fd = -1;
         }
-        usleep(100000);
+        r->psi_fds[k] = fd;
     }
+    r->psi_count = p->pressure_count;
+}
 
-    for (size_t i = 0; i < config->count; i++) {
-        if (runtime[i].pid > 0) {
+// every program gets a cgroup to track its whole tree; these are the
+// ones that can't do without. pool instances always have limits
+// through their pool's cgroup
+static int has_limits(const program_config_t *p) {
+    return p->memory_limit_bytes > 0 || p->cpu_limit > 0 || p->pool[0] ||
+           p->cpu_affinity[0] || p->numa_node[0] || p->memory_high_bytes >= 0 ||
+           p->memory_swap_max_bytes >= 0 || p->cpu_weight > 0 || p->pids_max >= 0 ||
+           p->io_max[0] || p->io_weight[0] || p->standby_freeze || p->pressure_count > 0;
+}
+
+// cpu_affinity without a cpuset controller: pin the process itself
+static void pin_cpus(const program_config_t *p, pid_t pid) {
+    int cpus[CPU_SETSIZE];
+    int n = parse_cpu_list(p->cpu_affinity, cpus, CPU_SETSIZE);
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    for (int i = 0; i < n && i < CPU_SETSIZE; i++)
+        if (cpus[i] < CPU_SETSIZE) CPU_SET(cpus[i], &set);
+    if (sched_setaffinity(pid, sizeof(set), &set) != 0)
+        log_message("Failed to pin %s to cpus %s: %s\n", p->name, p->cpu_affinity, strerror(errno));
+}
+
+// spawn a single program, born inside its cgroup when it has limits
+// supervisor/<name><suffix>, or <pool>/<instance><suffix> for pools. a
+// path that doesn't fit is an error: cut short, <name>.standby could
+// name the program's own cgroup
+static int cgroup_path(const program_config_t *p, const char *suffix, char *buf, size_t len,
+                       cgroup_error_t *err) {
+    int n = p->pool[0] ? snprintf(buf, len, "%s/%d%s", p->pool, p->instance, suffix)
+                       : snprintf(buf, len, "%s%s", p->name, suffix);
+    if (n < 0 || (size_t)n >= len) {
+        err->err = ENAMETOOLONG;
+        err->op = "mkdir";
+        snprintf(err->file, sizeof(err->file), "%s%s", p->name, suffix);
+        return -1;
+    }
+    return 0;
+}
+
+// sockets outlive restarts; a reload that changed listen= opens the new
+// set before dropping the old, so shared addresses stay bound
+static int refresh_listen(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    if (!r->listen ? p->listen[0] == '\0' : strcmp(r->listen, p->listen) == 0)
+        return 0;
+
+    char err[160];
+    int fds[MAX_LISTEN_FDS];
+    int n = p->listen[0] ? listen_open(p->listen, fds, MAX_LISTEN_FDS, err, sizeof(err)) : 0;
+    char *copy = n > 0 ? strdup(p->listen) : NULL;
+    if (n < 0 || (n > 0 && !copy)) {
+        if (n > 0) listen_close(p->listen);
+        char ts[64];
+        timestamp(ts, sizeof(ts));
+        if (n > 0) snprintf(err, sizeof(err), "out of memory");
+        printf("[%s] Failed to listen for %s: %s\n", ts, p->name, err);
+        log_message("Failed to listen for %s: %s\n", p->name, err);
+        return -1;
+    }
+    if (r->listen) listen_close(r->listen);
+    free(r->listen);
+    r->listen = copy;
+    r->listen_count = n;
+    memcpy(r->listen_fds, fds, (size_t)n * sizeof(int));
+    return 0;
+}
+
+// fork/exec one process of the slot into cg (which may be closed) with
+// the slot's output pipes and sockets; its pid and pidfd both map to
+// the slot. *pidfd is -1 when exits arrive through SIGCHLD instead
+static pid_t spawn_child(size_t slot, cgroup_t *cg, int *pidfd) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    int shared = p->stdout_path[0] && strcmp(p->stdout_path, p->stderr_path) == 0;
+    int fd_out = r->out ? r->out->write_fd : -1;
+    int fd_err = r->err ? r->err->write_fd : (shared ? fd_out : -1);
+
+    char *const sh_argv[] = { (char *)"sh", (char *)"-c", (char *)p->command, NULL };
+    spawn_req_t req = {
+        .path = p->shell ? "/bin/sh" : p->exec_path,
+        .argv = p->shell ? sh_argv : p->argv,
+        .envp = NULL,
+        .stdout_fd = fd_out,
+        .stderr_fd = fd_err,
+        .cgroup_fd = cg->dirfd,
+        .sigmask = &orig_mask,
+        .listen_fds = r->listen_fds,
+        .listen_count = r->listen_count,
+        .engine = cg->killed ? SPAWN_VFORK : SPAWN_AUTO,   // see cgroup_kill
+    };
+
+    fflush(stdout);   // don't let a fork-style child inherit pending output
+    int fd;
+    pid_t pid = spawn_process(&req, &fd);
+
+    if(pid < 0) {
+        int saved = errno;
+        perror("spawn failed");
+        log_message("Failed to spawn %s: %s\n", p->name, strerror(saved));
+        return -1;
+    }
+
+    // threads it starts before this lands keep the old mask; the
+    // cpuset path has no such window
+    if (p->cpu_affinity[0] && strcmp(cg->cpus, p->cpu_affinity) != 0)
+        pin_cpus(p, pid);
+
+    // exit notification arrives on the pidfd, no polling needed
+    *pidfd = -1;
+    if (have_pidfd) {
+        if (fd < 0) fd = pidfd_open(pid);
+        if (fd < 0 || event_add(fd, EPOLLIN, on_child_exit, NULL) != 0) {
+            perror("pidfd_open failed");
+            if (fd >= 0) close(fd);
+        } else {
+            *pidfd = fd;
+            pidmap_put(&pidfd_index, fd, slot);
+        }
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    pidmap_put(&pid_index, pid, slot);
+    return pid;
+}
+
+static void spawn_program(size_t slot) {
+    program_config_t *p = slot_program(slot);
+    program_runtime_t *r = &runtime[slot];
+    uint64_t t0 = now_us();
+
+    // the cgroup is created once per slot and its dirfd reused on
+    // restart; limits are only written when they change
+    int limited = has_limits(p);
+    if (r->cg.dirfd >= 0 || (!no_cgroup2 && (limited || !cgroups_unavailable))) {
+        cgroup_error_t err;
+        char path[CGROUP_PATH_LEN];
+        int rc = r->cg.dirfd < 0 ? cgroup_path(p, "", path, sizeof(path), &err) : 0;
+        if (rc == 0 && r->cg.dirfd < 0) rc = cgroup_open(&r->cg, path, &err);
+        if (rc == 0) rc = cgroup_apply(&r->cg, p, &err);
+        if (rc != 0 && r->cg.dirfd < 0 && err.err == ENOTSUP) {
+            // nothing to retry: every program runs without a cgroup
+            char ts[64], msg[128];
             timestamp(ts, sizeof(ts));
-            runtime[i].state = STATE_KILLED;
-            printf("[%s] %s (PID %d, state=%s) did not exit, sending SIGKILL\n",
-                   ts, config->programs[i].name, runtime[i].pid, state_to_str(runtime[i].state));
-            log_message(" %s (PID %d, state=%s) did not exit, sending SIGKILL\n",
-                    config->programs[i].name, runtime[i].pid, state_to_str(runtime[i].state));
-            kill(-runtime[i].pid, SIGKILL);
-            waitpid(runtime[i].pid, NULL, 0);
-            runtime[i].pid = 0;
+            cgroup_strerror(&err, msg, sizeof(msg));
+            printf("[%s] No cgroup2 mount (%s), running programs without cgroups or limits\n", ts, msg);
+            log_message("No cgroup2 mount (%s), running programs without cgroups or limits\n", msg);
+            no_cgroup2 = cgroups_unavailable = 1;
+        } else if (rc != 0 && limited) {
+            char ts[64], msg[128];
+            timestamp(ts, sizeof(ts));
+            cgroup_strerror(&err, msg, sizeof(msg));
+            printf("[%s] Failed to apply cgroup for %s: %s\n", ts, p->name, msg);
+            log_message("Failed to apply cgroup for %s: %s\n", p->name, msg);
+        } else if (rc != 0 && r->cg.dirfd < 0) {
+            // said once; the rest fall back to the process group quietly
+            char msg[128];
+            cgroup_strerror(&err, msg, sizeof(msg));
+            log_message("No cgroup for %s (%s), tracking programs by process group only\n",
+                        p->name, msg);
+            cgroups_unavailable = 1;
         }
     }
 
-    printf("All children terminated, exiting supervisor.\n");
-    log_message("All children terminated, exiting supervisor.\n");
+    // output pipes are created on first spawn and outlive restarts;
+    // stdout and stderr share one pipe when they go to the same file
+    int shared = p->stdout_path[0] && strcmp(p->stdout_path, p->stderr_path) == 0;
+
+    // a reload may have pointed them at different files
+    if (r->out && strcmp(r->out->path, p->stdout_path) != 0) {
+        output_close(r->out);
+        r->out = NULL;
+    }
+    if (r->err && (shared || strcmp(r->err->path, p->stderr_path) != 0)) {
+        output_close(r->err);
+        r->err = NULL;
+    }
+
+    if(!r->out && p->stdout_path[0]) {
+        r->out = output_open(p->stdout_path, p->stdout_maxbytes, p->stdout_backups);
+        if(!r->out) perror("open stdout");
+    }
+
+    if(!r->err && p->stderr_path[0] && !shared) {
+        r->err = output_open(p->stderr_path, p->stderr_maxbytes, p->stderr_backups);
+        if(!r->err) perror("open stderr");
+    }
+
+    if (refresh_listen(slot) != 0) {
+        r->state = STATE_FAILED;
+        return;
+    }
+
+    watch_memory_events(slot);
+    watch_cgroup_state(slot);
+    if (r->psi_count == 0 && p->pressure_count > 0) arm_pressure(slot);
+
+    // stat files stay open for the life of the slot
+    if (!r->sampler && r->cg.dirfd >= 0 && cfg->sample_interval > 0)
+        r->sampler = sampler_open(r->cg.dirfd);
+
+    int pidfd;
+    pid_t pid = spawn_child(slot, &r->cg, &pidfd);
+    if (pid < 0) return;
+
+    uint64_t t1 = now_us();
+    hist_record(&spawn_hist, t1 - t0);
+    if (r->crashed_us) {
+        hist_record(&restart_hist, t1 - r->crashed_us);
+        r->crashed_us = 0;
+    }
+
+    r->pid = pid;
+    r->pidfd = pidfd;
+    r->started_ms = timer_now_ms();
+
+    // ready right away, or once it has stayed up for startsecs and,
+    // with a healthcheck, passed a probe
+    int gated = p->startsecs > 0 || p->health_type != HEALTH_NONE;
+    r->state = gated ? STATE_STARTING : STATE_RUNNING;
+    r->health_ok = r->health_failures = 0;
+    char ts[64];
+    timestamp(ts, sizeof(ts));
+    printf("[%s] Spawned %s (PID %d, state=%s)\n", ts, p->name, pid, state_to_str(r->state));
+    log_message("Spawned %s (PID %d, state=%s)\n", p->name, pid, state_to_str(r->state));
+
+    if (p->startsecs > 0)
+        r->ready_timer = timer_add(p->startsecs * 1000ull, on_ready_timer, (void *)(uintptr_t)slot);
+    else if (!gated)
+        mark_ready(slot);
+    if (p->health_type != HEALTH_NONE)
+        schedule_health(slot, HEALTH_FIRST_MS);
 }
 
-// fork + exec a single program
-static void spawn_program(program_config_t *p, program_runtime_t *r) {
-    pid_t pid = fork();
-    if(pid < 0) {
-        perror("fork failed");
+// spawn now if every dependency is ready, otherwise when the last one is
+static void launch(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+
+    if (!running) return;
+    if (r->waiting_on > 0) {
+        r->start_pending = 1;
+        r->state = STATE_WAITING;
         return;
     }
+    r->start_pending = 0;
+    spawn_program(slot);
+}
 
-    if(pid == 0) { // child
-        setpgid(0, 0);
+// dependents gated on this program may go; each waits only for its own
+// prerequisites, so boot time follows the longest chain
+static void mark_ready(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
 
-        int fd_out = -1;
-        int fd_err = -1;
+    if (r->ready) return;
+    r->ready = 1;
+    if (p->standby && r->spare.pid <= 0)
+        spawn_spare(slot);
 
-        if(p->stdout_path[0]) {
-            fd_out = open(p->stdout_path, O_CREAT | O_WRONLY | O_APPEND, 0644);
-            if(fd_out < 0) perror("open stdout");
+    if (!r->booted) {
+        r->booted = 1;
+        if (boot_pending > 0 && --boot_pending == 0) {
+            uint64_t took = timer_now_ms() - start_ms;
+            printf("All autostart programs ready in %llu ms\n", (unsigned long long)took);
+            log_message("All autostart programs ready in %llu ms\n", (unsigned long long)took);
         }
+    }
 
-        if(p->stderr_path[0]) {
-            if(fd_out >= 0 && strcmp(p->stdout_path, p->stderr_path) == 0) {
-                fd_err = fd_out;
-            } else {
-                fd_err = open(p->stderr_path, O_CREAT | O_WRONLY | O_APPEND, 0644);
-                if(fd_err < 0) perror("open stderr");
-            }
+    for (size_t k = 0; k < p->ndependents; k++) {
+        size_t d = prog_slot[p->dependents[k]];
+        if (runtime[d].waiting_on > 0 && --runtime[d].waiting_on == 0 && runtime[d].start_pending)
+            launch(d);
+    }
+}
+
+static void mark_unready(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    timer_cancel(r->ready_timer);
+    r->ready_timer = -1;
+    if (!r->ready) return;
+    r->ready = 0;
+
+    for (size_t k = 0; k < p->ndependents; k++)
+        runtime[prog_slot[p->dependents[k]]].waiting_on++;
+}
+
+// STARTING -> RUNNING once startsecs is over and a healthcheck, if
+// any, has passed
+static void check_ready(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    if (r->pid <= 0 || r->state != STATE_STARTING || r->ready_timer >= 0) return;
+    if (p->health_type != HEALTH_NONE && !r->health_ok) return;
+
+    r->state = STATE_RUNNING;
+    log_message(" %s is ready\n", p->name);
+    mark_ready(slot);
+}
+
+// survived startsecs
+static void on_ready_timer(void *ctx) {
+    size_t slot = (size_t)(uintptr_t)ctx;
+
+    runtime[slot].ready_timer = -1;
+    check_ready(slot);
+}
+
+// rebuild program -> slot and each slot's count of unready dependencies
+static int link_dependencies(void) {
+    size_t *map = realloc(prog_slot, (cfg->count ? cfg->count : 1) * sizeof(size_t));
+    if (!map) return -1;
+    prog_slot = map;
+
+    for (size_t i = 0; i < runtime_count; i++)
+        prog_slot[runtime[i].prog] = i;
+
+    for (size_t i = 0; i < runtime_count; i++) {
+        program_config_t *p = slot_program(i);
+        runtime[i].waiting_on = 0;
+        for (size_t k = 0; k < p->ndepends; k++)
+            runtime[i].waiting_on += !runtime[prog_slot[p->depends[k]]].ready;
+    }
+    return 0;
+}
+
+// base delay grown by factor per consecutive quick restart, capped at
+// max_sec and with up to jitter of it shaved off at random
+static uint64_t backoff_delay_ms(int base_sec, double factor, int max_sec,
+                                 double jitter, int streak) {
+    double delay = base_sec * 1000.0;
+    if (factor <= 1.0 || streak <= 1)
+        return (uint64_t)delay;
+
+    if (delay < BACKOFF_MIN_MS) delay = BACKOFF_MIN_MS;
+    for (int k = 1; k < streak; k++) {
+        delay *= factor;
+        if (max_sec > 0 && delay >= max_sec * 1000.0) break;
+    }
+    if (max_sec > 0 && delay > max_sec * 1000.0)
+        delay = max_sec * 1000.0;
+
+    delay -= delay * jitter * ((double)rand() / RAND_MAX);
+    return (uint64_t)delay;
+}
+
+static void on_restart_timer(void *ctx) {
+    size_t slot = (size_t)(uintptr_t)ctx;
+    program_runtime_t *r = &runtime[slot];
+
+    r->restart_timer = -1;
+    if (running && r->state == STATE_BACKOFF)
+        launch(slot);
+}
+
+// queue the restart on the timer heap instead of sleeping in the loop;
+// OOM kills back off on their own streak and settings
+static void schedule_restart(size_t slot, int oom) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    r->restarts++;
+    if (!r->crashed_us) r->crashed_us = now_us();
+    uint64_t uptime = timer_now_ms() - r->started_ms;
+    if (uptime >= BACKOFF_RESET_SEC * 1000ull)
+        r->backoff_streak = r->oom_streak = 0;
+
+    uint64_t delay;
+    if (oom)
+        delay = backoff_delay_ms(p->oom_restart_delay, p->oom_backoff_factor, p->oom_backoff_max,
+                                 p->backoff_jitter, ++r->oom_streak);
+    else
+        delay = backoff_delay_ms(p->restart_delay, p->backoff_factor, p->backoff_max,
+                                 p->backoff_jitter, ++r->backoff_streak);
+    if (delay == 0) {
+        launch(slot);
+        return;
+    }
+
+    r->state = STATE_BACKOFF;
+    r->restart_timer = timer_add(delay, on_restart_timer, (void *)(uintptr_t)slot);
+    if (r->restart_timer < 0) {
+        launch(slot);
+        return;
+    }
+    if (delay >= 1000)
+        log_message(" %s in backoff, restarting in %.1fs\n", p->name, delay / 1000.0);
+}
+
+static void on_health_timer(void *ctx);
+
+static void schedule_health(size_t slot, uint64_t delay_ms) {
+    program_runtime_t *r = &runtime[slot];
+
+    timer_cancel(r->health_timer);
+    r->health_timer = timer_add(delay_ms, on_health_timer, (void *)(uintptr_t)slot);
+}
+
+// no probes for a child that is gone or on its way out
+static void stop_health(program_runtime_t *r) {
+    timer_cancel(r->health_timer);
+    r->health_timer = -1;
+    health_cancel(r->health);
+}
+
+// one probe finished; the next is scheduled from here, so probes of a
+// program never overlap
+static void on_health_result(void *ctx, int ok, const char *detail) {
+    size_t slot = (size_t)(uintptr_t)ctx;
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    if (r->pid <= 0 || r->stop_requested || r->freeze) return;
+
+    if (ok) {
+        schedule_health(slot, p->health_interval * 1000ull);
+        r->health_failures = 0;
+        if (!r->health_ok) {
+            r->health_ok = 1;
+            check_ready(slot);
         }
+        if (r->state == STATE_UNHEALTHY) {
+            r->state = STATE_RUNNING;
+            log_message(" %s is healthy again\n", p->name);
+            mark_ready(slot);
+        }
+        return;
+    }
+
+    // startsecs doubles as the grace period before failures count
+    uint64_t next = r->health_ok ? p->health_interval * 1000ull : HEALTH_FIRST_MS;
+    if (next > p->health_interval * 1000ull) next = p->health_interval * 1000ull;
+    schedule_health(slot, next);
+    if (r->state == STATE_STARTING && r->ready_timer >= 0) return;
 
-        if(fd_out >= 0) { dup2(fd_out, STDOUT_FILENO); if(fd_out != fd_err) close(fd_out); }
-        if(fd_err >= 0) { dup2(fd_err, STDERR_FILENO); if(fd_err != fd_out) close(fd_err); }
+    if (++r->health_failures < p->health_retries) {
+        log_message(" %s health check failed (%d/%d): %s\n",
+                    p->name, r->health_failures, p->health_retries, detail);
+        return;
+    }
+    if (r->state == STATE_UNHEALTHY) return;
 
-        setvbuf(stdout, NULL, _IONBF, 0);
-        setvbuf(stderr, NULL, _IONBF, 0);
+    char ts[64];
+    timestamp(ts, sizeof(ts));
+    r->state = STATE_UNHEALTHY;
+    printf("[%s] %s (PID %d, state=%s) after %d failed health checks: %s\n",
+           ts, p->name, r->pid, state_to_str(r->state), r->health_failures, detail);
+    log_message(" %s (PID %d, state=%s) after %d failed health checks: %s\n",
+                p->name, r->pid, state_to_str(r->state), r->health_failures, detail);
+    mark_unready(slot);
 
-        execl("/bin/sh", "sh", "-c", p->command, NULL);
-        perror("exec failed");
-        exit(1);
+    // restarted like a failed exit; with autorestart=never it stays up,
+    // UNHEALTHY, until a probe passes again
+    int restart = running && p->autorestart != RESTART_NEVER;
+    if (restart && p->autorestart == RESTART_ON_FAILURE) {
+        if (p->max_restarts != 0 && r->restart_count >= p->max_restarts)
+            restart = 0;
+        else
+            r->restart_count++;
     }
-    else { // parent
-         r->pid = pid;
-        // apply cgroup limits
-        if (p->memory_limit_bytes > 0 || p->cpu_limit > 0) {
-            if (cgroup_setup(p, pid) != 0) {
-                char ts[64];
-                timestamp(ts, sizeof(ts));
-                printf("[%s] Failed to apply cgroup for %s (PID %d)\n", ts, p->name, pid);
-            }
+    if (restart) {
+        log_message(" Restarting %s\n", p->name);
+        restart_running(slot);
+    }
+}
+
+static void on_health_timer(void *ctx) {
+    size_t slot = (size_t)(uintptr_t)ctx;
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    r->health_timer = -1;
+    if (r->pid <= 0 || r->stop_requested || r->freeze || p->health_type == HEALTH_NONE) return;
+
+    if (!r->health && !(r->health = health_new(on_health_result, ctx))) {
+        schedule_health(slot, p->health_interval * 1000ull);
+        return;
+    }
+    // a timed-out exec probe still being reaped: skip this round
+    if (health_start(r->health, p, &orig_mask) != 0)
+        schedule_health(slot, p->health_interval * 1000ull);
+}
+
+// ---- drains: processes that lost their slot ----
+
+static void finish_drain(drain_t *d) {
+    for (drain_t **pp = &drains; *pp; pp = &(*pp)->next) {
+        if (*pp == d) {
+            *pp = d->next;
+            break;
         }
-        r->state = STATE_RUNNING;
-        char ts[64];
-        timestamp(ts, sizeof(ts));
-        printf("[%s] Spawned %s (PID %d, state=%s)\n", ts, p->name, pid, state_to_str(r->state));
-        log_message("Spawned %s (PID %d, state=%s)\n", p->name, pid, state_to_str(r->state));
     }
+    timer_cancel(d->timer);
+    if (d->pidfd >= 0) {
+        event_del(d->pidfd);
+        close(d->pidfd);
+    }
+    stopping_count--;
+    free(d);
 }
 
-// main supervisor loop
-void supervisor_run(supervisor_config_t *config) {
-    signal(SIGINT, handle_signal);
-    signal(SIGTERM, handle_signal);
+static void on_drain_exit(int fd, uint32_t events, void *ctx) {
+    (void)fd;
+    (void)events;
+    drain_t *d = ctx;
+    if (waitpid(d->pid, NULL, WNOHANG) == d->pid)
+        finish_drain(d);
+}
 
-    printf("\nStarting Supervisor ... \n");
-    log_message("\nStarting Supervisor ... \n");
+static void on_drain_timer(void *ctx) {
+    drain_t *d = ctx;
+    d->timer = -1;
+    signal_tree(d->pid, d->pidfd, SIGKILL);
+}
 
-    for(size_t i = 0; i < config->count; i++) {
-        runtime[i].pid = 0;
-        runtime[i].restart_count = 0;
-        runtime[i].state = STATE_STOPPED;
+// stop_signal now, SIGKILL after stop_timeout; the pid and pidfd leave
+// the slot's indexes, so its exit never reaches handle_exit
+static void drain(const program_config_t *p, pid_t pid, int pidfd) {
+    pidmap_remove(&pid_index, pid);
+    if (pidfd >= 0) {
+        pidmap_remove(&pidfd_index, pidfd);
+        event_del(pidfd);
     }
 
-    for(size_t i = 0; i < config->count; i++) {
-        if(config->programs[i].autostart)
-            spawn_program(&config->programs[i], &runtime[i]);
+    drain_t *d = calloc(1, sizeof(*d));
+    if (!d || (pidfd >= 0 && event_add(pidfd, EPOLLIN, on_drain_exit, d) != 0)) {
+        // nothing to track it with: don't leave it running
+        free(d);
+        signal_tree(pid, pidfd, SIGKILL);
+        waitpid(pid, NULL, 0);
+        if (pidfd >= 0) close(pidfd);
+        return;
     }
+    d->pid = pid;
+    d->pidfd = pidfd;
+    d->next = drains;
+    drains = d;
+    stopping_count++;
 
-    while(running) {
-        int status;
-        pid_t pid;
-
-        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-            for(size_t i = 0; i < config->count; i++) {
-                if(runtime[i].pid == pid) {
-                    program_config_t *p = &config->programs[i];
-
-                    char ts[64];
-                    timestamp(ts, sizeof(ts));
-
-                    int exit_status;
-                    if (WIFEXITED(status))
-                        exit_status = WEXITSTATUS(status);
-                    else if (WIFSIGNALED(status)) {
-                        int sig = WTERMSIG(status);
-                        exit_status = -sig;
-                        runtime[i].state = STATE_KILLED;
-                        printf("[%s] %s (PID %d, state=%s) killed by %s\n",
-                               ts, p->name, pid, state_to_str(runtime[i].state), sig_to_str(sig));
-                        log_message(" %s (PID %d, state=%s) killed by %s\n",
-                                p->name, pid, state_to_str(runtime[i].state), sig_to_str(sig));
-                        runtime[i].pid = 0;
-                        runtime[i].restart_count = 0;
-                        continue;
-                    } else
-                        exit_status = -1;
-
-                    runtime[i].state = (exit_status == 0) ? STATE_EXITED : STATE_FAILED;
-                    printf("[%s] %s (PID %d, state=%s) exited with %d\n",
-                           ts, p->name, pid, state_to_str(runtime[i].state), exit_status);
-                    log_message(" %s (PID %d, state=%s) exited with %d\n",
-                            p->name, pid, state_to_str(runtime[i].state), exit_status);
-
-                    int restart = 0;
-
-                    if(p->autorestart == RESTART_ALWAYS) {
-                        restart = 1;
-                    } else if(p->autorestart == RESTART_ON_FAILURE && exit_status != 0) {
-                        if(p->max_restarts == 0 || runtime[i].restart_count < p->max_restarts) {
-                            restart = 1;
-                            runtime[i].restart_count++;
-                        }
-                    }
-
-                    if(restart) {
-                        timestamp(ts, sizeof(ts));
-                        if(p->autorestart == RESTART_ON_FAILURE)
-                            log_message(" Restarting %s (%d/%d)\n", p->name,
-                                runtime[i].restart_count,
-                                p->max_restarts == 0 ? -1 : p->max_restarts);
-                        else {
-                            printf("[%s] Restarting %s\n", ts, p->name);
-                            log_message(" Restarting %s\n", p->name);
-                        }
-
-                        if(p->restart_delay > 0) sleep(p->restart_delay);
-                        spawn_program(p, &runtime[i]);
-                    } else {
-                        runtime[i].pid = 0;
-                        runtime[i].state = STATE_STOPPED;
-                        if(p->autorestart == RESTART_ON_FAILURE && exit_status != 0 &&
-                           p->max_restarts != 0 && runtime[i].restart_count >= p->max_restarts) {
-                            printf("[%s] %s reached max restarts (%d), not restarting\n",
-                                   ts, p->name, p->max_restarts);
-                            log_message(" %s reached max restarts (%d), not restarting\n",
-                                    p->name, p->max_restarts);
-                        }
-                    }
-                }
-            }
+    signal_tree(pid, pidfd, p->stop_signal);
+    d->timer = timer_add(p->stop_timeout * 1000ull, on_drain_timer, d);
+    log_message(" Stopping old %s (PID %d) with %s\n", p->name, pid, signal_str(p->stop_signal));
+}
+
+static drain_t *find_drain(pid_t pid) {
+    for (drain_t *d = drains; d; d = d->next) {
+        if (d->pid == pid) return d;
+    }
+    return NULL;
+}
+
+
+// ---- spare: warm standby or rolling replacement ----
+
+static void on_spare_timer(void *ctx);
+
+// the spare runs in <program>.standby with the program's limits, so it
+// can be frozen (or counted) apart from the active process
+static void spawn_spare(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+    spare_t *s = &r->spare;
+
+    if (!running || s->pid > 0 || r->retired) return;
+    timer_cancel(s->timer);
+    s->timer = -1;
+    if (refresh_listen(slot) != 0) return;
+
+    if (r->cg.dirfd >= 0) {
+        cgroup_error_t err;
+        char path[CGROUP_PATH_LEN];
+        int rc = s->cg.dirfd < 0 ? cgroup_path(p, ".standby", path, sizeof(path), &err) : 0;
+        if (rc == 0 && s->cg.dirfd < 0) rc = cgroup_open(&s->cg, path, &err);
+        if (rc == 0) rc = cgroup_apply(&s->cg, p, &err);
+        if (rc == 0 && s->frozen && (rc = cgroup_freeze(&s->cg, 0, &err)) == 0)
+            s->frozen = 0;
+        if (rc != 0) {
+            // outside any cgroup it would escape the program's limits
+            char msg[128];
+            cgroup_strerror(&err, msg, sizeof(msg));
+            log_message("Failed to apply standby cgroup for %s: %s\n", p->name, msg);
+            return;
         }
+    }
+
+    int pidfd;
+    pid_t pid = spawn_child(slot, &s->cg, &pidfd);
+    if (pid < 0) return;
+
+    s->pid = pid;
+    s->pidfd = pidfd;
+    s->ready = 0;
+    s->health_failures = 0;
+    s->started_ms = timer_now_ms();
+
+    uint64_t warmup = p->startsecs * 1000ull;
+    if (warmup < SPARE_WARMUP_MS) warmup = SPARE_WARMUP_MS;
+    s->timer = timer_add(warmup, on_spare_timer, (void *)(uintptr_t)slot);
+    log_message("Spawned %s for %s (PID %d)\n", r->rolling ? "replacement" : "standby", p->name, pid);
+}
+
+// stop the spare (thawed first, or it could not act on the signal) and
+// any pending respawn or rolling restart
+static void drop_spare(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    spare_t *s = &r->spare;
+
+    timer_cancel(s->timer);
+    s->timer = -1;
+    health_cancel(s->health);
+    r->rolling = 0;
+    if (s->frozen) {
+        cgroup_error_t err;
+        cgroup_freeze(&s->cg, 0, &err);
+        s->frozen = 0;
+    }
+    if (s->pid > 0) drain(slot_program(slot), s->pid, s->pidfd);
+    s->pid = 0;
+    s->pidfd = -1;
+    s->ready = 0;
+}
+
+// warm-up and probes passed: take over now, or wait (frozen) for the
+// active process to exit
+static void spare_ready(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+    spare_t *s = &r->spare;
+
+    s->ready = 1;
+    if (r->rolling || (r->pid <= 0 && r->state == STATE_BACKOFF)) {
+        handover(slot, 0);
+        return;
+    }
+    if (!p->standby) {
+        drop_spare(slot);
+        return;
+    }
+    if (p->standby_freeze && s->cg.dirfd >= 0) {
+        cgroup_error_t err;
+        if (cgroup_freeze(&s->cg, 1, &err) == 0) s->frozen = 1;
+    }
+    log_message(" Standby for %s (PID %d) is warm%s\n", p->name, s->pid, s->frozen ? ", frozen" : "");
+}
+
+static void on_spare_health(void *ctx, int ok, const char *detail) {
+    size_t slot = (size_t)(uintptr_t)ctx;
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+    spare_t *s = &r->spare;
+
+    if (s->pid <= 0) return;
+    if (ok) {
+        spare_ready(slot);
+        return;
+    }
+    if (++s->health_failures < p->health_retries) {
+        s->timer = timer_add(HEALTH_FIRST_MS, on_spare_timer, ctx);
+        return;
+    }
+
+    // a replacement that never gets healthy leaves the running one alone
+    int rolling = r->rolling;
+    log_message(" %s for %s (PID %d) failed %d health checks: %s\n", rolling ? "Replacement" : "Standby",
+                p->name, s->pid, s->health_failures, detail);
+    drop_spare(slot);
+    if (rolling)
+        log_message(" Rolling restart of %s aborted, keeping PID %d\n", p->name, r->pid);
+    else
+        s->timer = timer_add(p->health_interval * 1000ull, on_spare_timer, ctx);
+}
+
+// warm-up over (probe it, if there is a check), or time to respawn a
+// spare that crashed
+static void on_spare_timer(void *ctx) {
+    size_t slot = (size_t)(uintptr_t)ctx;
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+    spare_t *s = &r->spare;
+
+    s->timer = -1;
+    if (s->pid <= 0) {
+        if (p->standby && r->ready) spawn_spare(slot);
+        return;
+    }
+    if (p->health_type == HEALTH_NONE) {
+        spare_ready(slot);
+        return;
+    }
+    if (!s->health && !(s->health = health_new(on_spare_health, ctx))) {
+        spare_ready(slot);
+        return;
+    }
+    if (health_start(s->health, p, &orig_mask) != 0)
+        s->timer = timer_add(HEALTH_FIRST_MS, on_spare_timer, ctx);
+}
+
+// the spare exited before it was promoted
+static void spare_exited(size_t slot, int status) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+    spare_t *s = &r->spare;
+
+    pid_t pid = s->pid;
+    pidmap_remove(&pid_index, pid);
+    if (s->pidfd >= 0) {
+        pidmap_remove(&pidfd_index, s->pidfd);
+        event_del(s->pidfd);
+        close(s->pidfd);
+    }
+    s->pid = 0;
+    s->pidfd = -1;
+    s->ready = 0;
+    timer_cancel(s->timer);
+    s->timer = -1;
+    health_cancel(s->health);
+
+    int rolling = r->rolling;
+    r->rolling = 0;
+    if (!running) return;
+
+    char how[32];
+    if (WIFSIGNALED(status)) snprintf(how, sizeof(how), "killed by %s", signal_str(WTERMSIG(status)));
+    else snprintf(how, sizeof(how), "exited with %d", WEXITSTATUS(status));
+    log_message(" %s for %s (PID %d) %s\n", rolling ? "Replacement" : "Standby", p->name, pid, how);
+
+    if (rolling) {
+        log_message(" Rolling restart of %s aborted, keeping PID %d\n", p->name, r->pid);
+    } else if (p->standby) {
+        uint64_t delay = p->restart_delay > 0 ? p->restart_delay * 1000ull : SPARE_WARMUP_MS;
+        s->timer = timer_add(delay, on_spare_timer, (void *)(uintptr_t)slot);
+    }
+}
+
+// promote the ready spare to the slot's process: its processes move into
+// the program cgroup (thawing as they land) and a still-running active
+// process is drained. exited_us is when the active one died, 0 if it
+// was replaced on purpose
+static void handover(size_t slot, uint64_t exited_us) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+    spare_t *s = &r->spare;
+    uint64_t t0 = now_us();
+
+    timer_cancel(r->restart_timer);
+    r->restart_timer = -1;
+    timer_cancel(r->ready_timer);
+    r->ready_timer = -1;
+    stop_health(r);
+    if (r->pid > 0) drain(p, r->pid, r->pidfd);
 
-        usleep(100000);
+    cgroup_error_t err;
+    if (s->cg.dirfd >= 0 && r->cg.dirfd >= 0 && cgroup_migrate(&s->cg, &r->cg, &err) != 0) {
+        char msg[128];
+        cgroup_strerror(&err, msg, sizeof(msg));
+        log_message("Failed to move %s standby into its cgroup: %s\n", p->name, msg);
     }
+    if (s->frozen && cgroup_freeze(&s->cg, 0, &err) == 0)
+        s->frozen = 0;
 
-    shutdown_children(config, 3);
+    r->pid = s->pid;
+    r->pidfd = s->pidfd;
+    r->started_ms = s->started_ms;
+    r->state = STATE_RUNNING;
+    r->health_ok = 1;
+    r->health_failures = 0;
+    r->rolling = 0;
+    s->pid = 0;
+    s->pidfd = -1;
+    s->ready = 0;
+    timer_cancel(s->timer);
+    s->timer = -1;
 
-    for (size_t i = 0; i < config->count; i++) 
-    {
-        cgroup_cleanup(config->programs[i].name);
+    uint64_t took = now_us() - t0;
+    if (exited_us) {
+        hist_record(&restart_hist, now_us() - exited_us);
+        r->restarts++;
     }
-     
+    char ts[64];
+    timestamp(ts, sizeof(ts));
+    printf("[%s] Promoted %s standby (PID %d) in %lluus\n", ts, p->name, r->pid, (unsigned long long)took);
+    log_message("Promoted %s standby (PID %d) in %lluus\n", p->name, r->pid, (unsigned long long)took);
+
+    if (p->health_type != HEALTH_NONE)
+        schedule_health(slot, p->health_interval * 1000ull);
+    if (r->ready) {
+        if (p->standby) spawn_spare(slot);
+    } else {
+        mark_ready(slot);   // spawns the next standby
+    }
+}
+
+// replace a running program: hand over to a warm standby at once, start
+// a rolling replacement, or stop it and start it again. rolling needs
+// the output pipes unchanged, as old and new share them for a while
+static void restart_running(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    if (r->rolling) return;   // already on its way
+    if (r->freeze) set_frozen(slot, FREEZE_NONE);
+    if (r->spare.ready) {
+        handover(slot, 0);
+        return;
+    }
+    int pipes_same = (!r->out ? !p->stdout_path[0] : strcmp(r->out->path, p->stdout_path) == 0) &&
+                     (!r->err || strcmp(r->err->path, p->stderr_path) == 0);
+    if (p->restart_mode == RESTART_MODE_ROLLING && r->pid > 0 && !r->leftovers && pipes_same) {
+        r->rolling = 1;
+        if (r->spare.pid <= 0) spawn_spare(slot);
+        if (r->spare.pid > 0) return;
+        r->rolling = 0;
+    }
+    r->restart_requested = 1;
+    stop_program(slot);
+}
+
+
+// periodic resource sample of every program cgroup
+static void on_sample_tick(void *ctx) {
+    (void)ctx;
+    uint32_t t = (uint32_t)((timer_now_ms() - start_ms) / 1000);
+
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (runtime[i].sampler)
+            sampler_read(runtime[i].sampler, t);
+    }
+    sample_timer = timer_add(cfg->sample_interval * 1000ull, on_sample_tick, NULL);
+}
+
+// freeze policy: while host pressure is over a threshold, freeze one
+// more freeze_on_pressure program per check, the highest priority value
+// (stopped first, so least important) first. once every watched avg10
+// is below half its threshold, thaw them one per check in reverse
+static void on_pressure_tick(void *ctx) {
+    (void)ctx;
+    double mem = 0, cpu = 0;
+    double mem_max = cfg->freeze_memory_pressure, cpu_max = cfg->freeze_cpu_pressure;
+
+    if (host_memory_pressure >= 0) pressure_read(host_memory_pressure, &mem);
+    if (host_cpu_pressure >= 0) pressure_read(host_cpu_pressure, &cpu);
+    int over = (mem_max > 0 && mem >= mem_max) || (cpu_max > 0 && cpu >= cpu_max);
+    int calm = (mem_max <= 0 || mem < mem_max / 2) && (cpu_max <= 0 || cpu < cpu_max / 2);
+
+    long pick = -1;
+    for (size_t i = 0; i < runtime_count; i++) {
+        program_runtime_t *r = &runtime[i];
+        program_config_t *p = slot_program(i);
+        if (r->retired) continue;
+        if (over && r->freeze == FREEZE_NONE && r->state == STATE_RUNNING &&
+            p->freeze_on_pressure && r->cg.state_fd >= 0) {
+            if (pick < 0 || p->priority >= slot_program((size_t)pick)->priority) pick = (long)i;
+        } else if (calm && r->freeze == FREEZE_PRESSURE) {
+            if (pick < 0 || p->priority < slot_program((size_t)pick)->priority) pick = (long)i;
+        }
+    }
+    if (pick >= 0) {
+        log_message("Host pressure memory=%.2f%% cpu=%.2f%%, %s %s\n", mem, cpu,
+                    over ? "freezing" : "thawing", slot_program((size_t)pick)->name);
+        set_frozen((size_t)pick, over ? FREEZE_PRESSURE : FREEZE_NONE);
+    }
+    pressure_timer = timer_add(PRESSURE_CHECK_MS, on_pressure_tick, NULL);
+}
+
+// (re)arm the policy from the current config; programs it froze that
+// no longer opt in, or all of them when it is off, are thawed
+static void setup_pressure_policy(void) {
+    timer_cancel(pressure_timer);
+    pressure_timer = -1;
+    if (host_memory_pressure >= 0) close(host_memory_pressure);
+    if (host_cpu_pressure >= 0) close(host_cpu_pressure);
+    host_memory_pressure = host_cpu_pressure = -1;
+
+    int on = cfg->freeze_memory_pressure > 0 || cfg->freeze_cpu_pressure > 0;
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (runtime[i].freeze == FREEZE_PRESSURE && (!on || !slot_program(i)->freeze_on_pressure))
+            set_frozen(i, FREEZE_NONE);
+    }
+    if (!on) return;
+
+    // no PSI (CONFIG_PSI off, or psi=0 on the command line): policy off
+    if ((cfg->freeze_memory_pressure > 0 &&
+         (host_memory_pressure = pressure_open(HOST_PRESSURE_DIR "/memory")) < 0) ||
+        (cfg->freeze_cpu_pressure > 0 &&
+         (host_cpu_pressure = pressure_open(HOST_PRESSURE_DIR "/cpu")) < 0)) {
+        printf("Pressure freeze disabled: %s: %s\n", HOST_PRESSURE_DIR, strerror(errno));
+        log_message("Pressure freeze disabled: %s: %s\n", HOST_PRESSURE_DIR, strerror(errno));
+        if (host_memory_pressure >= 0) close(host_memory_pressure);
+        host_memory_pressure = -1;
+        return;
+    }
+    pressure_timer = timer_add(PRESSURE_CHECK_MS, on_pressure_tick, NULL);
+}
+
+// metric{program="name"} ahead of one sample value
+static void series(metrics_buf_t *b, const char *metric, size_t slot) {
+    metrics_printf(b, "%s{program=\"", metric);
+    metrics_label(b, slot_program(slot)->name);
+    metrics_printf(b, "\"} ");
+}
+
+// Prometheus text format; everything comes from counters already kept
+// in memory, so a render costs no syscalls beyond the clock
+static void render_metrics(metrics_buf_t *b) {
+    uint64_t now = timer_now_ms();
+    b->len = 0;
 
-}
\ No newline at end of file
+    metrics_header(b, "supervisor_program_state", "gauge", "Current state of each program (always 1).");
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (runtime[i].retired) continue;
+        metrics_printf(b, "supervisor_program_state{program=\"");
+        metrics_label(b, slot_program(i)->name);
+        metrics_printf(b, "\",state=\"%s\"} 1\n", state_to_str(runtime[i].state));
+    }
+
+    metrics_header(b, "supervisor_program_restarts_total", "counter", "Restarts applied by the restart policy.");
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (runtime[i].retired) continue;
+        series(b, "supervisor_program_restarts_total", i);
+        metrics_printf(b, "%llu\n", (unsigned long long)runtime[i].restarts);
+    }
+
+    metrics_header(b, "supervisor_program_oom_kills_total", "counter", "OOM kills seen in the program's cgroup.");
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (runtime[i].retired) continue;
+        series(b, "supervisor_program_oom_kills_total", i);
+        metrics_printf(b, "%d\n", runtime[i].oom_count);
+    }
+
+    metrics_header(b, "supervisor_program_last_exit_code", "gauge", "Exit code of the last run, negative for a signal.");
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (runtime[i].retired) continue;
+        series(b, "supervisor_program_last_exit_code", i);
+        metrics_printf(b, "%d\n", runtime[i].last_exit);
+    }
+
+    metrics_header(b, "supervisor_program_uptime_seconds", "gauge", "Seconds since the running process was spawned, 0 when down.");
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (runtime[i].retired) continue;
+        series(b, "supervisor_program_uptime_seconds", i);
+        metrics_printf(b, "%.3f\n", runtime[i].pid > 0 ? (now - runtime[i].started_ms) / 1000.0 : 0.0);
+    }
+
+    // cgroup samples, only for programs that have them
+    metrics_header(b, "supervisor_program_memory_bytes", "gauge", "memory.current at the last sample.");
+    for (size_t i = 0; i < runtime_count; i++) {
+        const resource_sample_t *s = runtime[i].sampler ? sampler_latest(runtime[i].sampler) : NULL;
+        if (runtime[i].retired || !s) continue;
+        series(b, "supervisor_program_memory_bytes", i);
+        metrics_printf(b, "%llu\n", (unsigned long long)s->mem_current_kb * 1024);
+    }
+    metrics_header(b, "supervisor_program_cpu_seconds_total", "counter", "cpu.stat usage_usec at the last sample.");
+    for (size_t i = 0; i < runtime_count; i++) {
+        const resource_sample_t *s = runtime[i].sampler ? sampler_latest(runtime[i].sampler) : NULL;
+        if (runtime[i].retired || !s) continue;
+        series(b, "supervisor_program_cpu_seconds_total", i);
+        metrics_printf(b, "%.6f\n", s->cpu_usage_usec / 1e6);
+    }
+
+    metrics_histogram(b, "supervisor_spawn_duration_seconds",
+                      "Time to spawn a program: cgroup setup, output pipes and clone.", &spawn_hist);
+    metrics_histogram(b, "supervisor_restart_latency_seconds",
+                      "From a program's exit to its replacement's spawn, backoff included.", &restart_hist);
+    metrics_histogram(b, "supervisor_loop_iteration_seconds",
+                      "Time the event loop spends awake per wakeup.", &loop_hist);
+
+    metrics_header(b, "supervisor_uptime_seconds", "gauge", "Seconds since the supervisor started.");
+    metrics_printf(b, "supervisor_uptime_seconds %.3f\n", (now - start_ms) / 1000.0);
+}
+
+// rewrite metrics_file every metrics_interval for a textfile collector
+static void on_metrics_tick(void *ctx) {
+    (void)ctx;
+    render_metrics(&metrics_out);
+    if (metrics_write_file(cfg->metrics_file, &metrics_out) != 0)
+        log_message("Failed to write metrics to %s: %s\n", cfg->metrics_file, strerror(errno));
+    metrics_timer = timer_add(cfg->metrics_interval * 1000ull, on_metrics_tick, NULL);
+}
+
+// pick up oom_kill increments from memory.events
+static void refresh_oom(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    uint64_t kills;
+
+    if (r->cg.events_fd < 0 || cgroup_read_oom_kills(&r->cg, &kills) != 0)
+        return;
+    if (kills > r->cg.oom_kills) {
+        program_config_t *p = slot_program(slot);
+        r->oom_count += (int)(kills - r->cg.oom_kills);
+        r->oom_pending = 1;
+        log_message(" OOM kill in %s (memory.max=%ld, total oom kills=%d)\n",
+                p->name, p->memory_limit_bytes, r->oom_count);
+    }
+    r->cg.oom_kills = kills;
+}
+
+// memory.events changed (EPOLLPRI): report OOM kills as they happen,
+// even when they hit a grandchild rather than the tracked PID
+static void on_memory_events(int fd, uint32_t events, void *ctx) {
+    (void)fd;
+    (void)events;
+    refresh_oom((size_t)(uintptr_t)ctx);
+}
+
+// state transition + restart decision for one reaped child
+static void handle_exit(size_t i, pid_t pid, int status) {
+    program_config_t *p = slot_program(i);
+    uint64_t exited_us = now_us();
+
+    int unhealthy = runtime[i].state == STATE_UNHEALTHY;
+    release_pid(&runtime[i]);
+    if (runtime[i].freeze) {   // or the next spawn starts frozen
+        cgroup_freeze(&runtime[i].cg, 0, NULL);
+        runtime[i].freeze = FREEZE_NONE;
+    }
+    // a squeezed memory.high is put back by the next spawn's cgroup_apply
+    timer_cancel(runtime[i].trigger_timer);
+    runtime[i].trigger_timer = -1;
+    runtime[i].squeezed = 0;
+    mark_unready(i);
+    stop_health(&runtime[i]);
+
+    // the notification may still be in flight, so check the counter now
+    int oom = 0;
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL) {
+        refresh_oom(i);
+        oom = runtime[i].oom_pending;
+    }
+    runtime[i].oom_pending = 0;
+
+    char ts[64];
+    timestamp(ts, sizeof(ts));
+
+    int exit_status;
+    if (WIFEXITED(status)) {
+        exit_status = WEXITSTATUS(status);
+        runtime[i].state = (exit_status == 0) ? STATE_EXITED : STATE_FAILED;
+        printf("[%s] %s (PID %d, state=%s) exited with %d\n",
+               ts, p->name, pid, state_to_str(runtime[i].state), exit_status);
+        log_message(" %s (PID %d, state=%s) exited with %d\n",
+                p->name, pid, state_to_str(runtime[i].state), exit_status);
+    } else if (WIFSIGNALED(status)) {
+        int sig = WTERMSIG(status);
+        exit_status = -sig;
+        runtime[i].state = oom ? STATE_OOM : STATE_KILLED;
+        printf("[%s] %s (PID %d, state=%s) killed by %s%s\n",
+               ts, p->name, pid, state_to_str(runtime[i].state), signal_str(sig),
+               oom ? " (out of memory)" : "");
+        log_message(" %s (PID %d, state=%s) killed by %s%s\n",
+                p->name, pid, state_to_str(runtime[i].state), signal_str(sig),
+                oom ? " (out of memory)" : "");
+    } else {
+        exit_status = -1;
+        runtime[i].state = STATE_FAILED;
+    }
+    runtime[i].last_exit = exit_status;
+
+    // stopped from the control socket: no restart policy, maybe a respawn
+    if (runtime[i].stop_requested) {
+        timer_cancel(runtime[i].stop_timer);
+        runtime[i].stop_timer = -1;
+        runtime[i].stop_requested = 0;
+        runtime[i].state = STATE_STOPPED;
+        stopping_count--;
+        if (runtime[i].retired)
+            release_slot(&runtime[i]);
+        else if (runtime[i].restart_requested) {
+            runtime[i].restart_requested = 0;
+            if (runtime[i].spare.ready)
+                handover(i, 0);
+            else if (unhealthy)   // backs off like any other failure
+                schedule_restart(i, 0);
+            else
+                launch(i);
+        }
+        return;
+    }
+
+    // a signal death is a failure like any other exit code
+    restart_policy_t policy = oom ? p->oom_restart : p->autorestart;
+    int restart = 0;
+
+    if(policy == RESTART_ALWAYS) {
+        restart = 1;
+    } else if(policy == RESTART_ON_FAILURE && exit_status != 0) {
+        if(p->max_restarts == 0 || runtime[i].restart_count < p->max_restarts) {
+            restart = 1;
+            runtime[i].restart_count++;
+        }
+    }
+
+    // nothing comes back up once shutdown has begun
+    if (!running) restart = 0;
+
+    if(restart) {
+        timestamp(ts, sizeof(ts));
+        if(policy == RESTART_ON_FAILURE)
+            log_message(" Restarting %s (%d/%d)\n", p->name,
+                runtime[i].restart_count,
+                p->max_restarts == 0 ? -1 : p->max_restarts);
+        else {
+            printf("[%s] Restarting %s\n", ts, p->name);
+            log_message(" Restarting %s\n", p->name);
+        }
+
+        // a warm standby takes over without the restart delay
+        if (runtime[i].spare.ready)
+            handover(i, exited_us);
+        else
+            schedule_restart(i, oom);
+    } else {
+        drop_spare(i);
+        if (!oom) runtime[i].state = STATE_STOPPED;   // OOM stays visible
+        if(policy == RESTART_ON_FAILURE && exit_status != 0 &&
+           p->max_restarts != 0 && runtime[i].restart_count >= p->max_restarts) {
+            printf("[%s] %s reached max restarts (%d), not restarting\n",
+                   ts, p->name, p->max_restarts);
+            log_message(" %s reached max restarts (%d), not restarting\n",
+                    p->name, p->max_restarts);
+        }
+    }
+}
+
+// SIGKILL for everything the program started: its whole cgroup at
+// once, or the process group without one
+static void kill_tree(program_runtime_t *r) {
+    if (r->cg.dirfd >= 0 && cgroup_kill(&r->cg, NULL) == 0) return;
+    if (r->pid > 0) signal_tree(r->pid, r->pidfd, SIGKILL);
+}
+
+// the tracked process exited but what it started is still in its
+// cgroup (daemonized, setsid()'d workers): kill all of it and leave the
+// pid unreaped, so it can't be reused, until cgroup.events reports the
+// group empty. returns 0 when there is nothing to wait for
+static int kill_leftovers(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+    int populated;
+
+    if (r->leftovers) return 1;
+    if (r->cg.state_fd < 0 || cgroup_read_state(&r->cg, &populated, NULL) != 0 || !populated)
+        return 0;
+
+    cgroup_error_t err;
+    if (cgroup_kill(&r->cg, &err) != 0) {
+        char msg[128];
+        cgroup_strerror(&err, msg, sizeof(msg));
+        log_message("Failed to kill what %s left behind: %s\n", slot_program(slot)->name, msg);
+        return 0;
+    }
+    event_del(r->pidfd);   // stays readable until reaped
+    stop_health(r);
+    r->leftovers = 1;
+    log_message(" %s (PID %d) exited, killing the rest of its cgroup\n", slot_program(slot)->name, r->pid);
+    return 1;
+}
+
+// FROZEN once the kernel reports every task stopped, RUNNING again
+// once it reports them thawed
+static void check_frozen(size_t slot, int frozen) {
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+    unsigned long long took = (unsigned long long)(now_us() - r->freeze_us);
+
+    if (frozen && r->freeze && r->state == STATE_RUNNING) {
+        r->state = STATE_FROZEN;
+        log_message(" Froze %s (PID %d) in %lluus%s\n", p->name, r->pid, took,
+                    r->freeze == FREEZE_PRESSURE ? ", host under pressure" :
+                    r->freeze == FREEZE_TRIGGER ? ", pressure trigger" : "");
+    } else if (!frozen && !r->freeze && r->state == STATE_FROZEN) {
+        r->state = STATE_RUNNING;
+        r->health_failures = 0;
+        log_message(" Thawed %s (PID %d) in %lluus\n", p->name, r->pid, took);
+        if (p->health_type != HEALTH_NONE)
+            schedule_health(slot, HEALTH_FIRST_MS);
+    }
+}
+
+// write cgroup.freeze; the state follows cgroup.events, often before
+// this returns. probes pause while frozen so a stopped program can't
+// turn UNHEALTHY
+static int set_frozen(size_t slot, freeze_reason_t why) {
+    program_runtime_t *r = &runtime[slot];
+    cgroup_error_t err;
+
+    if (r->cg.dirfd < 0 || cgroup_freeze(&r->cg, why != FREEZE_NONE, &err) != 0) {
+        if (r->cg.dirfd >= 0) {
+            char msg[128];
+            cgroup_strerror(&err, msg, sizeof(msg));
+            log_message("Failed to %s %s: %s\n", why ? "freeze" : "thaw", slot_program(slot)->name, msg);
+        }
+        return -1;
+    }
+    r->freeze = why;
+    r->freeze_us = now_us();
+    if (why) stop_health(r);
+
+    int frozen;
+    if (r->cg.state_fd >= 0 && cgroup_read_state(&r->cg, NULL, &frozen) == 0)
+        check_frozen(slot, frozen);
+    return 0;
+}
+
+// cgroup.events changed (EPOLLPRI): once a program with leftovers is
+// empty its exit is final; otherwise a freeze or thaw went through
+static void on_cgroup_events(int fd, uint32_t events, void *ctx) {
+    (void)fd;
+    (void)events;
+    size_t slot = (size_t)(uintptr_t)ctx;
+    program_runtime_t *r = &runtime[slot];
+    int populated, frozen, status;
+
+    if (cgroup_read_state(&r->cg, &populated, &frozen) != 0) return;
+    if (!r->leftovers) {
+        check_frozen(slot, frozen);
+        return;
+    }
+    if (populated) return;
+    r->leftovers = 0;
+    pid_t pid = r->pid;
+    if (waitpid(pid, &status, WNOHANG) == pid)
+        handle_exit(slot, pid, status);
+}
+
+// pressure_cooldown passed without a trigger: memory.high back to its
+// configured value, and a program a trigger froze runs again
+static void on_trigger_cooldown(void *ctx) {
+    size_t slot = (size_t)(uintptr_t)ctx;
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+
+    r->trigger_timer = -1;
+    if (r->squeezed) {
+        cgroup_error_t err;
+        r->squeezed = 0;
+        if (cgroup_apply(&r->cg, p, &err) == 0) {
+            log_message(" Pressure on %s eased, memory.high restored\n", p->name);
+        } else {
+            char msg[128];
+            cgroup_strerror(&err, msg, sizeof(msg));
+            log_message("Failed to restore memory.high for %s: %s\n", p->name, msg);
+        }
+    }
+    if (r->freeze == FREEZE_TRIGGER) set_frozen(slot, FREEZE_NONE);
+}
+
+// a PSI trigger fired (EPOLLPRI): the program's tasks stalled for
+// stall_ms within window_ms. the kernel reports at most once per window
+static void on_pressure_trigger(int fd, uint32_t events, void *ctx) {
+    size_t slot = (size_t)(uintptr_t)ctx / MAX_PRESSURE_TRIGGERS;
+    int k = (int)((uintptr_t)ctx % MAX_PRESSURE_TRIGGERS);
+    program_runtime_t *r = &runtime[slot];
+    program_config_t *p = slot_program(slot);
+    const pressure_trigger_t *t = &p->pressure[k];
+
+    if (events & EPOLLERR) {   // the cgroup went away under it
+        event_del(fd);
+        close(fd);
+        r->psi_fds[k] = -1;
+        return;
+    }
+    if (r->pid <= 0 || r->retired) return;
+
+    double avg10 = 0;
+    pressure_read(fd, &avg10);
+    char ts[64];
+    timestamp(ts, sizeof(ts));
+    printf("[%s] %s %s pressure on %s (PID %d): %dms stalled in %dms, avg10 %.2f%%, %s\n", ts,
+           pressure_resource_str(t->resource), t->full ? "full" : "some", p->name, r->pid,
+           t->stall_ms, t->window_ms, avg10, pressure_action_str(t->action));
+    log_message("%s %s pressure on %s (PID %d): %dms stalled in %dms, avg10 %.2f%%, %s\n",
+                pressure_resource_str(t->resource), t->full ? "full" : "some", p->name, r->pid,
+                t->stall_ms, t->window_ms, avg10, pressure_action_str(t->action));
+
+    uint64_t now = timer_now_ms();
+    switch (t->action) {
+    case PRESSURE_LOG:
+        return;
+    case PRESSURE_THROTTLE: {
+        cgroup_error_t err;
+        if (cgroup_squeeze_memory(&r->cg, &err) != 0) {
+            char msg[128];
+            cgroup_strerror(&err, msg, sizeof(msg));
+            log_message("Failed to throttle %s: %s\n", p->name, msg);
+            return;
+        }
+        r->squeezed = 1;
+        break;
+    }
+    case PRESSURE_FREEZE:
+        if (r->state == STATE_RUNNING && r->freeze == FREEZE_NONE && r->cg.state_fd >= 0)
+            set_frozen(slot, FREEZE_TRIGGER);
+        break;
+    case PRESSURE_RESTART:
+        // once per cooldown, so the replacement gets a chance to settle
+        if (r->trigger_restart_ms && now - r->trigger_restart_ms < p->pressure_cooldown * 1000ull)
+            return;
+        if (r->stop_requested || (r->state != STATE_RUNNING && r->state != STATE_UNHEALTHY))
+            return;
+        r->trigger_restart_ms = now;
+        restart_running(slot);
+        return;
+    }
+
+    // undone once the triggers stay quiet for pressure_cooldown
+    timer_cancel(r->trigger_timer);
+    r->trigger_timer = timer_add(p->pressure_cooldown * 1000ull, on_trigger_cooldown,
+                                 (void *)(uintptr_t)slot);
+}
+
+// pidfd became readable: that child has exited
+static void on_child_exit(int fd, uint32_t events, void *ctx) {
+    (void)events;
+    (void)ctx;
+    long slot = pidmap_get(&pidfd_index, fd);
+    if (slot < 0) return;
+
+    program_runtime_t *r = &runtime[slot];
+    pid_t pid = fd == r->spare.pidfd ? r->spare.pid : r->pid;
+    if (pid == r->pid && kill_leftovers((size_t)slot)) return;
+    int status;
+    if (waitpid(pid, &status, WNOHANG) != pid) return;
+    if (pid == r->spare.pid)
+        spare_exited((size_t)slot, status);
+    else
+        handle_exit((size_t)slot, pid, status);
+}
+
+// SIGCHLD fallback for kernels without pidfd_open
+static void reap_children(void) {
+    int status;
+    pid_t pid;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        long slot = pidmap_get(&pid_index, pid);
+        drain_t *d;
+        if (slot >= 0 && pid == runtime[slot].spare.pid)
+            spare_exited((size_t)slot, status);
+        else if (slot >= 0) {
+            // already reaped, so nothing to wait on: just don't let
+            // leftovers outlive it
+            if (runtime[slot].cg.dirfd >= 0) cgroup_kill(&runtime[slot].cg, NULL);
+            handle_exit((size_t)slot, pid, status);
+        } else if ((d = find_drain(pid)))
+            finish_drain(d);
+    }
+}
+
+static void on_signal(int fd, uint32_t events, void *ctx) {
+    (void)events;
+    (void)ctx;
+    struct signalfd_siginfo si;
+
+    while (read(fd, &si, sizeof(si)) == sizeof(si)) {
+        if (si.ssi_signo == SIGCHLD)
+            reap_children();
+        else if (si.ssi_signo == SIGHUP)
+            reload_config();
+        else
+            running = 0;
+    }
+}
+
+// a control argument names one program or every instance of a pool
+static int names_slot(size_t slot, const char *name) {
+    program_config_t *p = slot_program(slot);
+    return !runtime[slot].retired && (strcmp(p->name, name) == 0 || strcmp(p->pool, name) == 0);
+}
+
+// stop did not finish within the grace period
+static void on_stop_timer(void *ctx) {
+    size_t slot = (size_t)(uintptr_t)ctx;
+    program_runtime_t *r = &runtime[slot];
+
+    r->stop_timer = -1;
+    if (r->pid > 0) {
+        log_message(" %s (PID %d) did not stop, sending SIGKILL\n", slot_program(slot)->name, r->pid);
+        kill_tree(r);
+    }
+}
+
+// stop_signal to the process group, SIGKILL after stop_timeout; the
+// exit comes back through handle_exit
+static void stop_program(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+
+    timer_cancel(r->restart_timer);
+    r->restart_timer = -1;
+    r->start_pending = 0;
+    r->crashed_us = 0;
+    drop_spare(slot);
+
+    if (r->pid <= 0) {
+        r->state = STATE_STOPPED;
+        return;
+    }
+    if (r->stop_requested) return;
+
+    program_config_t *p = slot_program(slot);
+    if (r->freeze) set_frozen(slot, FREEZE_NONE);   // a frozen program can't act on stop_signal
+    r->stop_requested = 1;
+    if (r->state != STATE_UNHEALTHY)   // stays visible until the exit
+        r->state = STATE_STOPPING;
+    stopping_count++;
+    stop_health(r);
+    signal_tree(r->pid, r->pidfd, p->stop_signal);
+    r->stop_timer = timer_add(p->stop_timeout * 1000ull, on_stop_timer, (void *)(uintptr_t)slot);
+    log_message(" Stopping %s (PID %d) with %s\n", p->name, r->pid, signal_str(p->stop_signal));
+}
+
+static void start_program(size_t slot) {
+    program_runtime_t *r = &runtime[slot];
+
+    timer_cancel(r->restart_timer);
+    r->restart_timer = -1;
+    r->restart_count = r->backoff_streak = r->oom_streak = 0;
+    r->crashed_us = 0;
+    launch(slot);
+}
+
+static void status_line(size_t slot, ctl_reply_t *reply) {
+    program_runtime_t *r = &runtime[slot];
+    const resource_sample_t *s = r->sampler ? sampler_latest(r->sampler) : NULL;
+    uint64_t uptime = r->pid > 0 ? (timer_now_ms() - r->started_ms) / 1000 : 0;
+
+    // the second process, if any: "next=" for a rolling replacement
+    char spare[48] = "";
+    if (r->spare.pid > 0)
+        snprintf(spare, sizeof(spare), " %s=%d(%s)", r->rolling ? "next" : "standby", r->spare.pid,
+                 r->spare.frozen ? "frozen" : r->spare.ready ? "warm" : "starting");
+
+    if (s)
+        ctl_printf(reply, "%s %s pid=%d uptime=%llus restarts=%d oom=%d mem=%ukB cpu=%llums%s\n",
+                   slot_program(slot)->name, state_to_str(r->state), r->pid,
+                   (unsigned long long)uptime, r->restart_count, r->oom_count,
+                   s->mem_current_kb, (unsigned long long)(s->cpu_usage_usec / 1000), spare);
+    else
+        ctl_printf(reply, "%s %s pid=%d uptime=%llus restarts=%d oom=%d%s\n",
+                   slot_program(slot)->name, state_to_str(r->state), r->pid,
+                   (unsigned long long)uptime, r->restart_count, r->oom_count, spare);
+}
+
+// the sample ring of one slot, oldest first, one line per sample
+static void history_lines(size_t slot, ctl_reply_t *reply) {
+    resource_sample_t h[SAMPLE_HISTORY];
+    size_t n = sampler_history(runtime[slot].sampler, h, SAMPLE_HISTORY);
+
+    for (size_t k = 0; k < n; k++)
+        ctl_printf(reply, "%s t=%us mem=%ukB peak=%ukB anon=%ukB file=%ukB cpu=%llums "
+                   "throttled=%llums rbytes=%llu wbytes=%llu\n",
+                   slot_program(slot)->name, h[k].t, h[k].mem_current_kb, h[k].mem_peak_kb,
+                   h[k].mem_anon_kb, h[k].mem_file_kb,
+                   (unsigned long long)(h[k].cpu_usage_usec / 1000),
+                   (unsigned long long)(h[k].cpu_throttled_usec / 1000),
+                   (unsigned long long)h[k].io_rbytes, (unsigned long long)h[k].io_wbytes);
+}
+
+// start/stop/restart/signal one slot, then its status line
+static int control_one(const char *cmd, size_t slot, int sig, ctl_reply_t *reply) {
+    program_runtime_t *r = &runtime[slot];
+    const char *name = slot_program(slot)->name;
+
+    if (strcmp(cmd, "start") == 0) {
+        start_program(slot);
+        if (r->pid <= 0 && r->state != STATE_WAITING) {
+            ctl_error(reply, "%s failed to start", name);
+            return -1;
+        }
+    } else if (strcmp(cmd, "stop") == 0) {
+        r->restart_requested = 0;
+        stop_program(slot);
+    } else if (strcmp(cmd, "restart") == 0) {
+        if (r->pid > 0) {
+            restart_running(slot);
+        } else {
+            start_program(slot);
+        }
+    } else if (strcmp(cmd, "freeze") == 0 || strcmp(cmd, "thaw") == 0) {
+        freeze_reason_t why = strcmp(cmd, "freeze") == 0 ? FREEZE_MANUAL : FREEZE_NONE;
+        if (r->freeze != why && set_frozen(slot, why) != 0) {
+            ctl_error(reply, "%s: %s failed", name, cmd);
+            return -1;
+        }
+    } else if (signal_tree(r->pid, r->pidfd, sig) != 0) {
+        ctl_error(reply, "kill failed: %s", strerror(errno));
+        return -1;
+    }
+    status_line(slot, reply);
+    return 0;
+}
+
+// one control socket request; runs inside the event loop, so it must not block
+static void control_command(int argc, char **argv, ctl_reply_t *reply) {
+    const char *cmd = argv[0];
+
+    if (strcmp(cmd, "status") == 0) {
+        // no names or --all: every program in one reply
+        if (argc == 1 || (argc == 2 && strcmp(argv[1], "--all") == 0)) {
+            for (size_t i = 0; i < runtime_count; i++) {
+                if (!runtime[i].retired)
+                    status_line(i, reply);
+            }
+            return;
+        }
+        for (int a = 1; a < argc; a++) {
+            size_t found = 0;
+            for (size_t i = 0; i < runtime_count; i++) {
+                if (names_slot(i, argv[a])) {
+                    status_line(i, reply);
+                    found++;
+                }
+            }
+            if (!found) {
+                ctl_error(reply, "no such program: %s", argv[a]);
+                return;
+            }
+        }
+        return;
+    }
+
+    // the last SAMPLE_HISTORY samples of each named program (or pool)
+    if (strcmp(cmd, "history") == 0) {
+        if (argc < 2) {
+            ctl_error(reply, "usage: history <program>...");
+            return;
+        }
+        for (int a = 1; a < argc; a++) {
+            size_t found = 0;
+            for (size_t i = 0; i < runtime_count; i++) {
+                if (names_slot(i, argv[a])) {
+                    history_lines(i, reply);
+                    found++;
+                }
+            }
+            if (!found) {
+                ctl_error(reply, "no such program: %s", argv[a]);
+                return;
+            }
+        }
+        return;
+    }
+
+    // quantiles of the latency histograms the metrics export
+    if (strcmp(cmd, "latency") == 0) {
+        const struct { const char *name; const histogram_t *h; } hists[] = {
+            { "spawn", &spawn_hist }, { "restart", &restart_hist }, { "loop", &loop_hist },
+        };
+        for (size_t k = 0; k < sizeof(hists) / sizeof(hists[0]); k++) {
+            const histogram_t *h = hists[k].h;
+            ctl_printf(reply, "%s count=%llu p50=%lluus p99=%lluus max=%lluus\n", hists[k].name,
+                       (unsigned long long)h->count,
+                       (unsigned long long)hist_quantile(h, 0.50),
+                       (unsigned long long)hist_quantile(h, 0.99),
+                       (unsigned long long)h->max_us);
+        }
+        return;
+    }
+
+    if (strcmp(cmd, "metrics") == 0) {
+        render_metrics(&metrics_out);
+        const char *line = metrics_out.data, *end = metrics_out.data + metrics_out.len;
+        while (line < end) {
+            const char *nl = memchr(line, '\n', (size_t)(end - line));
+            ctl_printf(reply, "%.*s\n", (int)(nl - line), line);
+            line = nl + 1;
+        }
+        return;
+    }
+
+    if (strcmp(cmd, "start") != 0 && strcmp(cmd, "stop") != 0 &&
+        strcmp(cmd, "restart") != 0 && strcmp(cmd, "signal") != 0 &&
+        strcmp(cmd, "freeze") != 0 && strcmp(cmd, "thaw") != 0) {
+        ctl_error(reply, "unknown command: %s", cmd);
+        return;
+    }
+    int want = strcmp(cmd, "signal") == 0 ? 3 : 2;
+    if (argc != want) {
+        ctl_error(reply, "usage: %s <program>%s", cmd, want == 3 ? " <signal>" : "");
+        return;
+    }
+
+    int sig = 0;
+    if (want == 3 && (sig = parse_signal(argv[2])) < 0) {
+        ctl_error(reply, "unknown signal: %s", argv[2]);
+        return;
+    }
+
+    // a pool name acts on each instance, all or nothing
+    size_t found = 0;
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (!names_slot(i, argv[1])) continue;
+        found++;
+        if (strcmp(cmd, "start") == 0 && runtime[i].pid > 0) {
+            ctl_error(reply, "%s is already running", slot_program(i)->name);
+            return;
+        }
+        if (want == 3 && runtime[i].pid <= 0) {
+            ctl_error(reply, "%s is not running", slot_program(i)->name);
+            return;
+        }
+        if (strcmp(cmd, "freeze") == 0 && runtime[i].state != STATE_RUNNING &&
+            runtime[i].state != STATE_FROZEN) {
+            ctl_error(reply, "%s is %s, only RUNNING programs can be frozen",
+                      slot_program(i)->name, state_to_str(runtime[i].state));
+            return;
+        }
+        if (strcmp(cmd, "freeze") == 0 && runtime[i].cg.state_fd < 0) {
+            ctl_error(reply, "%s has no cgroup to freeze", slot_program(i)->name);
+            return;
+        }
+    }
+    if (!found) {
+        ctl_error(reply, "no such program: %s", argv[1]);
+        return;
+    }
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (names_slot(i, argv[1]) && control_one(cmd, i, sig, reply) != 0)
+            return;
+    }
+}
+
+static int same_str(const char *a, const char *b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+// anything that only takes effect in a fresh process
+static int needs_restart(const program_config_t *a, const program_config_t *b) {
+    return strcmp(a->command, b->command) != 0 || a->shell != b->shell ||
+           !same_str(a->exec_path, b->exec_path) ||
+           strcmp(a->stdout_path, b->stdout_path) != 0 ||
+           strcmp(a->stderr_path, b->stderr_path) != 0 ||
+           strcmp(a->listen, b->listen) != 0;
+}
+
+static int same_triggers(const program_config_t *a, const program_config_t *b) {
+    if (a->pressure_count != b->pressure_count) return 0;
+    for (int k = 0; k < a->pressure_count; k++) {
+        const pressure_trigger_t *x = &a->pressure[k], *y = &b->pressure[k];
+        if (x->resource != y->resource || x->full != y->full || x->stall_ms != y->stall_ms ||
+            x->window_ms != y->window_ms || x->action != y->action)
+            return 0;
+    }
+    return 1;
+}
+
+static int limits_changed(const program_config_t *a, const program_config_t *b) {
+    return a->memory_limit_bytes != b->memory_limit_bytes || a->cpu_limit != b->cpu_limit ||
+           a->cpu_period_us != b->cpu_period_us || a->memory_high_bytes != b->memory_high_bytes ||
+           a->memory_swap_max_bytes != b->memory_swap_max_bytes || a->cpu_weight != b->cpu_weight ||
+           a->pids_max != b->pids_max || strcmp(a->io_max, b->io_max) != 0 ||
+           strcmp(a->io_weight, b->io_weight) != 0 ||
+           a->pool_memory_limit_bytes != b->pool_memory_limit_bytes ||
+           a->pool_cpu_limit != b->pool_cpu_limit ||
+           strcmp(a->cpu_affinity, b->cpu_affinity) != 0 || strcmp(a->numa_node, b->numa_node) != 0 ||
+           !same_triggers(a, b);
+}
+
+// slot for name, retired slots included so a re-added program reuses its slot
+static long find_any_slot(const char *name, const unsigned char *taken) {
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (!taken[i] && strcmp(slot_program(i)->name, name) == 0)
+            return (long)i;
+    }
+    return -1;
+}
+
+typedef enum {
+    RELOAD_REMOVE,     // not in the new config
+    RELOAD_KEEP,       // settings only, picked up by the next decision
+    RELOAD_LIMITS,     // rewrite cgroup limits in place
+    RELOAD_RESTART,    // command or output changed
+    RELOAD_REVIVE      // retired earlier, back in the config
+} reload_action_t;
+
+// SIGHUP: load the config again and apply only what changed
+static void reload_config(void) {
+    supervisor_config_t next;
+    if (load_config(cfg_path, &next) != 0) {
+        printf("Reload of %s failed, keeping the running config\n", cfg_path);
+        log_message("Reload of %s failed, keeping the running config\n", cfg_path);
+        return;
+    }
+
+    size_t slots = runtime_count;
+    unsigned char *action = calloc(slots ? slots : 1, 1);          // RELOAD_REMOVE = 0
+    long *slot_of = malloc((next.count ? next.count : 1) * sizeof(long));
+    size_t *prog_of = malloc((slots ? slots : 1) * sizeof(size_t));
+    unsigned char *taken = calloc(slots ? slots : 1, 1);
+    if (!action || !slot_of || !prog_of || !taken) {
+        log_message("Reload of %s failed: out of memory\n", cfg_path);
+        free(taken);
+        free(action);
+        free(slot_of);
+        free(prog_of);
+        free_config(&next);
+        return;
+    }
+
+    // diff against the running config while both are alive
+    for (size_t j = 0; j < next.count; j++) {
+        long slot = find_any_slot(next.programs[j].name, taken);
+        slot_of[j] = slot;
+        if (slot < 0) continue;
+
+        program_runtime_t *r = &runtime[slot];
+        program_config_t *old = slot_program((size_t)slot), *now = &next.programs[j];
+        taken[slot] = 1;
+        prog_of[slot] = j;
+
+        if (r->retired)
+            action[slot] = RELOAD_REVIVE;
+        else if (needs_restart(old, now))
+            action[slot] = RELOAD_RESTART;
+        else if (!limits_changed(old, now))
+            action[slot] = RELOAD_KEEP;
+        else    // a running child outside any cgroup can only be limited by respawning it
+            action[slot] = (r->cg.dirfd < 0 && r->pid > 0) ? RELOAD_RESTART : RELOAD_LIMITS;
+    }
+    free(taken);
+
+    size_t fresh = next.count;   // entries below are carried over, not new
+
+    // removed programs keep their entry (copied into the new config) until
+    // their slot is gone, so slot->prog never dangles
+    for (size_t i = 0; i < slots; i++) {
+        if (action[i] != RELOAD_REMOVE) continue;
+
+        long idx = config_adopt_program(&next, slot_program(i));
+        if (idx < 0) {
+            log_message("Reload of %s failed: out of memory\n", cfg_path);
+            free(action);
+            free(slot_of);
+            free(prog_of);
+            free_config(&next);
+            return;
+        }
+        prog_of[i] = (size_t)idx;
+    }
+
+    // the new config becomes the running one; control_socket and
+    // sample_interval changes are applied below
+    supervisor_config_t prev = *cfg;
+    *cfg = next;
+    for (size_t i = 0; i < slots; i++)
+        runtime[i].prog = prog_of[i];
+
+    size_t added = 0, removed = 0, restarted = 0, limited = 0;
+    for (size_t i = 0; i < slots; i++) {
+        program_runtime_t *r = &runtime[i];
+        program_config_t *p = slot_program(i);
+
+        // rotation settings apply to the open pipes right away
+        if (r->out) {
+            r->out->maxbytes = p->stdout_maxbytes;
+            r->out->backups = p->stdout_backups;
+        }
+        if (r->err) {
+            r->err->maxbytes = p->stderr_maxbytes;
+            r->err->backups = p->stderr_backups;
+        }
+
+        switch ((reload_action_t)action[i]) {
+        case RELOAD_REMOVE:
+            if (r->retired) break;
+            r->retired = 1;
+            r->restart_requested = 0;
+            stop_program(i);
+            if (r->pid <= 0) release_slot(r);
+            removed++;
+            break;
+        case RELOAD_REVIVE:
+            r->retired = 0;
+            if (r->pid > 0)
+                r->restart_requested = p->autostart;
+            else
+                r->start_pending = p->autostart;   // launched once edges are relinked
+            added++;
+            break;
+        case RELOAD_RESTART:
+            drop_spare(i);   // started from the old config
+            if (r->psi_count || p->pressure_count) arm_pressure(i);   // triggers may have changed too
+            if (r->pid > 0)
+                restart_running(i);
+            restarted++;
+            break;
+        case RELOAD_LIMITS:
+            if (r->cg.dirfd >= 0) {
+                cgroup_error_t err;
+                if (cgroup_apply(&r->cg, p, &err) != 0) {
+                    char msg[128];
+                    cgroup_strerror(&err, msg, sizeof(msg));
+                    log_message("Failed to update cgroup for %s: %s\n", p->name, msg);
+                }
+                if (r->spare.cg.dirfd >= 0) cgroup_apply(&r->spare.cg, p, &err);
+                watch_memory_events(i);
+                arm_pressure(i);
+            }
+            if (r->pid > 0 && p->cpu_affinity[0] && strcmp(r->cg.cpus, p->cpu_affinity) != 0)
+                pin_cpus(p, r->pid);
+            limited++;
+            break;
+        case RELOAD_KEEP:
+            break;
+        }
+
+        // probe settings are read per probe; only a healthcheck that was
+        // just added or removed needs the schedule touched
+        if (r->pid > 0 && !r->stop_requested) {
+            if (p->health_type != HEALTH_NONE && r->health_timer < 0 &&
+                !(r->health && health_busy(r->health)))
+                schedule_health(i, HEALTH_FIRST_MS);
+            else if (p->health_type == HEALTH_NONE)
+                check_ready(i);
+        }
+
+        // standby=1 added or removed
+        if (!p->standby && r->spare.pid > 0 && !r->rolling)
+            drop_spare(i);
+        else if (p->standby && r->ready && !r->stop_requested && r->spare.pid <= 0 && r->spare.timer < 0)
+            spawn_spare(i);
+    }
+
+    size_t first_new = runtime_count;
+    for (size_t j = 0; j < fresh; j++) {
+        if (slot_of[j] >= 0) continue;
+        if (alloc_slot(j) < 0) {
+            log_message("Out of memory adding %s\n", cfg->programs[j].name);
+            continue;
+        }
+        added++;
+    }
+
+    // edges may have changed: recount, then start what is now unblocked
+    if (link_dependencies() != 0)
+        log_message("Out of memory linking dependencies\n");
+    for (size_t i = 0; i < runtime_count; i++) {
+        if ((i >= first_new && slot_program(i)->autostart) ||
+            (runtime[i].start_pending && runtime[i].waiting_on == 0))
+            launch(i);
+    }
+
+    if (cfg->sample_interval != prev.sample_interval) {
+        timer_cancel(sample_timer);
+        sample_timer = -1;
+        if (cfg->sample_interval > 0)
+            sample_timer = timer_add(cfg->sample_interval * 1000ull, on_sample_tick, NULL);
+    }
+    if (strcmp(cfg->metrics_file, prev.metrics_file) != 0 ||
+        cfg->metrics_interval != prev.metrics_interval) {
+        timer_cancel(metrics_timer);
+        metrics_timer = -1;
+        if (cfg->metrics_file[0])
+            on_metrics_tick(NULL);
+    }
+    setup_pressure_policy();
+    if (strcmp(cfg->control_socket, prev.control_socket) != 0) {
+        control_close();
+        if (cfg->control_socket[0])
+            control_open(cfg->control_socket, control_command);
+    }
+
+    free_config(&prev);
+    free(action);
+    free(slot_of);
+    free(prog_of);
+
+    printf("Reloaded %s: %zu added, %zu removed, %zu restarted, %zu limits updated\n",
+           cfg_path, added, removed, restarted, limited);
+    log_message("Reloaded %s: %zu added, %zu removed, %zu restarted, %zu limits updated\n",
+                cfg_path, added, removed, restarted, limited);
+}
+
+// slots sorted by priority, then dependency level, ties in config order
+static int by_priority(const void *a, const void *b) {
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    int px = slot_program(x)->priority, py = slot_program(y)->priority;
+    if (px != py) return px < py ? -1 : 1;
+    int lx = slot_program(x)->level, ly = slot_program(y)->level;
+    if (lx != ly) return lx < ly ? -1 : 1;
+    return x < y ? -1 : (x > y);
+}
+
+static size_t *priority_order(void) {
+    size_t *order = malloc((runtime_count ? runtime_count : 1) * sizeof(size_t));
+    if (!order) return NULL;
+    for (size_t i = 0; i < runtime_count; i++)
+        order[i] = i;
+    qsort(order, runtime_count, sizeof(size_t), by_priority);
+    return order;
+}
+
+// stop every child in waves of equal priority and dependency level,
+// highest first, so dependents go before what they depend on; each wave
+// is signalled at once and ends when its last pidfd fires, with
+// stop_timeout escalating to SIGKILL per program
+static void shutdown_children(void) {
+    uint64_t t0 = timer_now_ms();
+
+    printf("\nStarting Shutdown!\n");
+    log_message("\nStarting Shutdown!\n");
+
+    size_t *order = priority_order();
+    size_t k = runtime_count;
+    while (order && k > 0) {
+        program_config_t *w = slot_program(order[k - 1]);
+        int prio = w->priority, level = w->level;
+        while (k > 0 && slot_program(order[k - 1])->priority == prio &&
+               slot_program(order[k - 1])->level == level) {
+            size_t slot = order[--k];
+            runtime[slot].restart_requested = 0;
+            stop_program(slot);
+        }
+
+        while (stopping_count > 0) {
+            log_flush();
+            if (event_wait(-1) < 0) break;
+        }
+    }
+    free(order);
+
+    // only reached when the loop itself failed
+    while (drains) {
+        signal_tree(drains->pid, drains->pidfd, SIGKILL);
+        waitpid(drains->pid, NULL, 0);
+        finish_drain(drains);
+    }
+    for (size_t i = 0; i < runtime_count; i++) {
+        if (runtime[i].pid > 0) {
+            kill_tree(&runtime[i]);
+            waitpid(runtime[i].pid, NULL, 0);
+            runtime[i].leftovers = 0;
+            release_pid(&runtime[i]);
+            runtime[i].state = STATE_KILLED;
+        }
+    }
+
+    uint64_t took = timer_now_ms() - t0;
+    printf("All children terminated in %llu ms, exiting supervisor.\n", (unsigned long long)took);
+    log_message("All children terminated in %llu ms, exiting supervisor.\n", (unsigned long long)took);
+}
+
+// block the signals we handle and route them through a signalfd
+static int setup_signals(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+
+    int probe = pidfd_open(getpid());
+    if (probe < 0) {
+        have_pidfd = 0;
+        sigaddset(&mask, SIGCHLD);
+    } else {
+        close(probe);
+    }
+
+    if (sigprocmask(SIG_BLOCK, &mask, &orig_mask) != 0) {
+        perror("sigprocmask failed");
+        return -1;
+    }
+
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) {
+        perror("signalfd failed");
+        return -1;
+    }
+    return event_add(signal_fd, EPOLLIN, on_signal, NULL);
+}
+
+// main supervisor loop
+void supervisor_run(supervisor_config_t *config, const char *config_path) {
+    cfg = config;
+    cfg_path = config_path;
+
+    srand((unsigned)getpid() ^ (unsigned)time(NULL));
+
+    // one pidfd per child plus pipes and cgroup files: the default soft
+    // limit of 1024 fds runs out long before the program count does
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    log_install_crash_flush();
+
+    if (event_init() != 0 || timer_init() != 0 || setup_signals() != 0) {
+        fprintf(stderr, "Failed to initialize event loop\n");
+        return;
+    }
+
+    printf("\nStarting Supervisor ... \n");
+    log_message("\nStarting Supervisor ... \n");
+
+    for(size_t i = 0; i < config->count; i++) {
+        if (alloc_slot(i) < 0) {
+            fprintf(stderr, "Out of memory allocating runtime slots\n");
+            return;
+        }
+    }
+
+    if (link_dependencies() != 0) {
+        fprintf(stderr, "Out of memory linking dependencies\n");
+        return;
+    }
+
+    // everything without unready dependencies starts now, the rest as
+    // their prerequisites report ready
+    start_ms = timer_now_ms();
+    for (size_t i = 0; i < runtime_count; i++)
+        boot_pending += slot_program(i)->autostart;
+
+    size_t *order = priority_order();
+    for(size_t i = 0; i < runtime_count; i++) {
+        size_t slot = order ? order[i] : i;
+        if(slot_program(slot)->autostart)
+            launch(slot);
+    }
+    free(order);
+
+    if (config->sample_interval > 0)
+        sample_timer = timer_add(config->sample_interval * 1000ull, on_sample_tick, NULL);
+
+    if (config->metrics_file[0])
+        metrics_timer = timer_add(config->metrics_interval * 1000ull, on_metrics_tick, NULL);
+
+    setup_pressure_policy();
+
+    // commands are served from this same loop, between child exits
+    if (config->control_socket[0])
+        control_open(config->control_socket, control_command);
+
+    // sleeps in epoll_wait until a child exits or a signal arrives;
+    // log lines queued by the previous iteration go out as one batch
+    while(running) {
+        log_flush();
+        if (event_woke_us())
+            hist_record(&loop_hist, now_us() - event_woke_us());
+        if (event_wait(-1) < 0)
+            break;
+    }
+
+    timer_cancel(sample_timer);
+    sample_timer = -1;
+    timer_cancel(metrics_timer);
+    metrics_timer = -1;
+    timer_cancel(pressure_timer);
+    pressure_timer = -1;
+
+    control_close();
+
+    // stop_program drops restarts still waiting out their backoff
+    shutdown_children();
+
+    for (size_t i = 0; i < runtime_count; i++)
+        release_slot(&runtime[i]);
+
+    event_del(signal_fd);
+    close(signal_fd);
+    timer_close();
+    event_close();
+
+    log_flush();
+
+    pidmap_free(&pid_index);
+    pidmap_free(&pidfd_index);
+    metrics_free(&metrics_out);
+    free(runtime);
+    free(prog_slot);
+    runtime = NULL;
+    prog_slot = NULL;
+    runtime_count = runtime_cap = 0;
+}
@@ -0,0 +1,184 @@
+#include "timer.h"
+#include "event.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+// one-shot timers kept in a binary min-heap ordered by deadline.
+// a single timerfd is armed for the earliest deadline.
+
+typedef struct {
+    uint64_t deadline;   // CLOCK_MONOTONIC ms
+    timer_fn_t fn;
+    void *ctx;
+    int heap_pos;        // -1 when free
+    int next_free;
+} timer_node_t;
+
+static int timer_fd = -1;
+static timer_node_t *nodes = NULL;
+static int nodes_cap = 0;
+static int free_head = -1;
+static int *heap = NULL;     // node ids
+static int heap_len = 0;
+
+
+uint64_t timer_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+
+static void heap_swap(int a, int b) {
+    int t = heap[a];
+    heap[a] = heap[b];
+    heap[b] = t;
+    nodes[heap[a]].heap_pos = a;
+    nodes[heap[b]].heap_pos = b;
+}
+
+static void sift_up(int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (nodes[heap[parent]].deadline <= nodes[heap[i]].deadline) break;
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void sift_down(int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < heap_len && nodes[heap[l]].deadline < nodes[heap[min]].deadline) min = l;
+        if (r < heap_len && nodes[heap[r]].deadline < nodes[heap[min]].deadline) min = r;
+        if (min == i) break;
+        heap_swap(i, min);
+        i = min;
+    }
+}
+
+static void heap_remove(int pos) {
+    heap_len--;
+    if (pos != heap_len) {
+        heap_swap(pos, heap_len);
+        sift_down(pos);
+        sift_up(pos);
+    }
+}
+
+
+// point the timerfd at the earliest deadline (or disarm)
+static void rearm(void) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+
+    if (heap_len > 0) {
+        uint64_t d = nodes[heap[0]].deadline;
+        its.it_value.tv_sec = d / 1000;
+        its.it_value.tv_nsec = (d % 1000) * 1000000;
+        if (d == 0) its.it_value.tv_nsec = 1;   // 0 would disarm
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+
+static void release(int id) {
+    heap_remove(nodes[id].heap_pos);
+    nodes[id].heap_pos = -1;
+    nodes[id].next_free = free_head;
+    free_head = id;
+}
+
+
+static void on_timer(int fd, uint32_t events, void *ctx) {
+    (void)events;
+    (void)ctx;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0) {
+        // spurious wakeup, still check the heap
+    }
+
+    uint64_t now = timer_now_ms();
+    while (heap_len > 0 && nodes[heap[0]].deadline <= now) {
+        int id = heap[0];
+        timer_fn_t fn = nodes[id].fn;
+        void *arg = nodes[id].ctx;
+
+        release(id);   // free before calling so fn may re-add
+        fn(arg);
+    }
+    rearm();
+}
+
+
+int timer_init(void) {
+    if (timer_fd >= 0) return 0;
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        perror("timerfd_create failed");
+        return -1;
+    }
+    return event_add(timer_fd, EPOLLIN, on_timer, NULL);
+}
+
+
+int timer_add(uint64_t delay_ms, timer_fn_t fn, void *ctx) {
+    if (free_head < 0) {
+        int cap = nodes_cap ? nodes_cap * 2 : 64;
+        timer_node_t *n = realloc(nodes, cap * sizeof(timer_node_t));
+        int *h = realloc(heap, cap * sizeof(int));
+        if (n) nodes = n;
+        if (h) heap = h;
+        if (!n || !h) return -1;
+
+        for (int i = cap - 1; i >= nodes_cap; i--) {
+            nodes[i].heap_pos = -1;
+            nodes[i].next_free = free_head;
+            free_head = i;
+        }
+        nodes_cap = cap;
+    }
+
+    int id = free_head;
+    free_head = nodes[id].next_free;
+
+    nodes[id].deadline = timer_now_ms() + delay_ms;
+    nodes[id].fn = fn;
+    nodes[id].ctx = ctx;
+    nodes[id].heap_pos = heap_len;
+    heap[heap_len++] = id;
+    sift_up(heap_len - 1);
+
+    if (heap[0] == id) rearm();
+    return id;
+}
+
+
+void timer_cancel(int id) {
+    if (id < 0 || id >= nodes_cap || nodes[id].heap_pos < 0) return;
+
+    int was_first = nodes[id].heap_pos == 0;
+    release(id);
+    if (was_first) rearm();
+}
+
+
+void timer_close(void) {
+    if (timer_fd >= 0) {
+        event_del(timer_fd);
+        close(timer_fd);
+    }
+    timer_fd = -1;
+
+    free(nodes);
+    free(heap);
+    nodes = NULL;
+    heap = NULL;
+    nodes_cap = heap_len = 0;
+    free_head = -1;
+}